@@ -0,0 +1,153 @@
+#ifndef HOLDTESTER_H
+#define HOLDTESTER_H
+
+#include <QObject>
+#include <QDebug>
+#include <QMap>
+#include <QVector>
+#include <QTimer>
+#include <QEventLoop>
+
+#include <atomic>
+#include <time.h>
+
+#include "recording.h"
+#include "replayer.h"
+
+// BUTTON_HOLD_TIME in tarnish, in milliseconds
+#define HOLD_TIME 700
+// Most milliseconds past HOLD_TIME a hold can fire and still pass
+#define HOLD_TOLERANCE 50
+// How long a short press is held, it must not count as a hold
+#define HOLD_SHORT_PRESS 300
+// How long to wait for a hold that didn't fire, or one that shouldn't
+#define HOLD_WAIT 2000
+
+// Presses a key on a virtual buttons device, once briefly and once for longer
+// than a hold, and checks when tarnish reports the key as held.
+class HoldTester : public QObject {
+    Q_OBJECT
+public:
+    HoldTester(std::atomic<bool>& stopped, QObject* parent = nullptr)
+    : QObject(parent),
+      stopped(stopped),
+      device(),
+      waiting(nullptr),
+      heldAt(-1),
+      holds(0),
+      fired(),
+      missed(0),
+      spurious(0) {}
+    bool createDevice(){
+        RecordedDevice buttons;
+        buttons.role = RecordedDevice::Buttons;
+        buttons.name = "buttons";
+        memset(&buttons.id, 0, sizeof(buttons.id));
+        buttons.id.bustype = BUS_VIRTUAL;
+        buttons.evBits.fill(0, EV_CNT / 8 + 1);
+        buttons.keyBits.fill(0, KEY_CNT / 8 + 1);
+        buttons.absBits.fill(0, ABS_CNT / 8 + 1);
+        buttons.propBits.fill(0, INPUT_PROP_CNT / 8 + 1);
+        for(auto type : {EV_SYN, EV_KEY}){
+            buttons.evBits[type / 8] = buttons.evBits[type / 8] | (1 << (type % 8));
+        }
+        for(auto key : {KEY_LEFT, KEY_HOME, KEY_RIGHT, KEY_POWER}){
+            buttons.keyBits[key / 8] = buttons.keyBits[key / 8] | (1 << (key % 8));
+        }
+        return device.create(buttons);
+    }
+    // Environment to point tarnish at the virtual device
+    QStringList environment(){ return QStringList() << "OXIDE_BUTTONS_DEVICE=" + device.path(); }
+    // Returns false if the run didn't behave
+    bool run(){
+        // A short press must not be held
+        holds = 0;
+        press(1);
+        wait(HOLD_SHORT_PRESS);
+        press(0);
+        wait(HOLD_WAIT - HOLD_SHORT_PRESS);
+        if(holds){
+            qDebug() << "A" << HOLD_SHORT_PRESS << "ms press was held";
+            spurious++;
+            return false;
+        }
+        // A long one is held once, released only after it fired
+        heldAt = -1;
+        auto pressed = press(1);
+        wait(HOLD_WAIT, true);
+        press(0);
+        if(heldAt == -1){
+            qDebug() << "Held key was never reported";
+            missed++;
+            return false;
+        }
+        auto after = (heldAt - pressed) / 1000;
+        fired.append(after);
+        return after >= HOLD_TIME && after <= HOLD_TIME + HOLD_TOLERANCE;
+    }
+    // Milliseconds from each long press to tarnish reporting it
+    const QVector<qint64>& results(){ return fired; }
+    int missedHolds(){ return missed; }
+    int spuriousHolds(){ return spurious; }
+
+public slots:
+    // timestamp is tarnish's deadline for the hold, in CLOCK_MONOTONIC
+    // microseconds
+    void keyHeld(QString key, qlonglong timestamp){
+        Q_UNUSED(timestamp);
+        if(key != "home"){
+            return;
+        }
+        holds++;
+        heldAt = now();
+        if(waiting != nullptr){
+            waiting->quit();
+        }
+    }
+
+private:
+    std::atomic<bool>& stopped;
+    VirtualDevice device;
+    QEventLoop* waiting;
+    // When the current hold was received, in CLOCK_MONOTONIC microseconds
+    qint64 heldAt;
+    int holds;
+    QVector<qint64> fired;
+    int missed;
+    int spurious;
+
+    static qint64 now(){
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return (qint64)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+    }
+    // Returns when it was written, in CLOCK_MONOTONIC microseconds
+    qint64 press(int value){
+        input_event events[2];
+        memset(events, 0, sizeof(events));
+        events[0].type = EV_KEY;
+        events[0].code = KEY_HOME;
+        events[0].value = value;
+        events[1].type = EV_SYN;
+        events[1].code = SYN_REPORT;
+        // Before writing, the kernel stamps the events while they're written
+        auto time = now();
+        if(!device.write(events, 2)){
+            qDebug() << "Failed to write to" << device.path() << strerror(errno);
+        }
+        return time;
+    }
+    // Handles signals for msecs, or until a hold if untilHeld
+    void wait(int msecs, bool untilHeld = false){
+        if(stopped.load()){
+            return;
+        }
+        QEventLoop loop;
+        QTimer::singleShot(msecs, &loop, &QEventLoop::quit);
+        waiting = untilHeld ? &loop : nullptr;
+        loop.exec();
+        waiting = nullptr;
+    }
+};
+
+#endif // HOLDTESTER_H
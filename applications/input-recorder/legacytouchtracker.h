@@ -0,0 +1,117 @@
+#ifndef LEGACYTOUCHTRACKER_H
+#define LEGACYTOUCHTRACKER_H
+
+#include <QMap>
+#include <QList>
+
+#include <linux/input.h>
+
+#include "touchtracker.h"
+
+// How SystemAPI followed touches before TouchTracker, kept so the two can be
+// compared. Contacts are allocated as they appear, and every frame sorts them
+// into lists of pressed, moved and released touches.
+class LegacyTouchTracker {
+public:
+    LegacyTouchTracker() : touches(), currentSlot(0), fingers(0) {}
+    ~LegacyTouchTracker(){ qDeleteAll(touches); }
+    // Returns true when event completes a frame, active() is then how many
+    // contacts are down
+    bool handle(const input_event& event){
+        switch(event.type){
+            case EV_SYN:
+                if(event.code != SYN_REPORT){
+                    return false;
+                }
+                frame();
+                return true;
+            case EV_ABS:{
+                if(event.code == ABS_MT_SLOT){
+                    currentSlot = event.value;
+                    getEvent(currentSlot)->modified = true;
+                    return false;
+                }
+                auto touch = getEvent(currentSlot);
+                switch(event.code){
+                    case ABS_MT_TRACKING_ID:
+                        if(event.value == -1){
+                            touch->active = false;
+                            currentSlot = 0;
+                        }else{
+                            touch->active = true;
+                            touch->id = event.value;
+                        }
+                    break;
+                    case ABS_MT_POSITION_X:
+                        touch->x = event.value;
+                    break;
+                    case ABS_MT_POSITION_Y:
+                        touch->y = event.value;
+                    break;
+                    case ABS_MT_PRESSURE:
+                        touch->pressure = event.value;
+                    break;
+                    case ABS_MT_TOUCH_MAJOR:
+                        touch->major = event.value;
+                    break;
+                    case ABS_MT_TOUCH_MINOR:
+                        touch->minor = event.value;
+                    break;
+                    case ABS_MT_ORIENTATION:
+                        touch->orientation = event.value;
+                    break;
+                }
+            }break;
+        }
+        return false;
+    }
+    int active() const{ return fingers; }
+
+private:
+    QMap<int, Touch*> touches;
+    int currentSlot;
+    int fingers;
+
+    Touch* getEvent(int slot){
+        if(!touches.contains(slot)){
+            touches.insert(slot, new Touch{
+                .slot = slot
+            });
+        }
+        return touches.value(slot);
+    }
+    void frame(){
+        // Always mark the current slot as modified
+        getEvent(currentSlot)->modified = true;
+        QList<Touch*> released;
+        QList<Touch*> pressed;
+        QList<Touch*> moved;
+        for(auto touch : touches.values()){
+            if(touch->id == -1){
+                touch->active = false;
+                released.append(touch);
+            }else if(!touch->active){
+                released.append(touch);
+            }else if(!touch->existing){
+                pressed.append(touch);
+            }else if(touch->modified){
+                moved.append(touch);
+            }
+        }
+        // Cleanup released touches
+        for(auto touch : released){
+            if(!touch->active){
+                touches.remove(touch->slot);
+                delete touch;
+            }
+        }
+        // Setup touches for next event set
+        for(auto touch : touches.values()){
+            touch->modified = false;
+            touch->existing = true;
+        }
+        fingers = touches.size();
+    }
+};
+
+#endif // LEGACYTOUCHTRACKER_H
@@ -0,0 +1,577 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QProcess>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QDebug>
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <signal.h>
+#include <unistd.h>
+
+#include "dbussettings.h"
+#include "devicesettings.h"
+#include "screencodec.h"
+#include "touchtracker.h"
+
+#include "dbusservice_interface.h"
+#include "systemapi_interface.h"
+#include "metricsapi_interface.h"
+
+#include "recorder.h"
+#include "replayer.h"
+#include "holdtester.h"
+#include "legacytouchtracker.h"
+
+using namespace codes::eeems::oxide1;
+
+static QTextStream qStdOut(stdout, QIODevice::WriteOnly);
+static std::atomic<bool> stopped(false);
+
+void unixSignalHandler(int signal){
+    Q_UNUSED(signal);
+    stopped.store(true);
+}
+
+qint64 percentile(const QVector<qint64>& sorted, double percent){
+    auto index = (int)std::ceil(sorted.size() * percent / 100.0) - 1;
+    return sorted[qBound(0, index, sorted.size() - 1)];
+}
+
+// User and system time used by a process so far in milliseconds, -1 if it
+// can't be read
+qint64 cpuTime(uint pid){
+    QFile file(QString("/proc/%1/stat").arg(pid));
+    if(!file.open(QIODevice::ReadOnly)){
+        return -1;
+    }
+    auto stat = QString(file.readAll());
+    // The name can contain spaces, everything after it is space separated
+    auto fields = stat.mid(stat.lastIndexOf(')') + 2).split(' ');
+    if(fields.size() < 13){
+        return -1;
+    }
+    // utime and stime, fields 14 and 15 in proc(5)
+    auto ticks = fields[11].toLongLong() + fields[12].toLongLong();
+    return ticks * 1000 / sysconf(_SC_CLK_TCK);
+}
+
+// Restarts tarnish through systemd to read the virtual devices
+void useDevices(const QStringList& environment){
+    qDebug() << "Restarting tarnish with the virtual devices...";
+    QProcess::execute("systemctl", QStringList() << "set-environment" << environment);
+    QProcess::execute("systemctl", QStringList() << "restart" << "tarnish");
+}
+
+void restoreDevices(const QStringList& environment){
+    qDebug() << "Restarting tarnish with the real devices...";
+    for(auto& variable : environment){
+        QProcess::execute("systemctl", QStringList() << "unset-environment" << variable.left(variable.indexOf('=')));
+    }
+    QProcess::execute("systemctl", QStringList() << "restart" << "tarnish");
+}
+
+void waitForTarnish(QDBusConnection& bus){
+    qDebug() << "Waiting for tarnish to start up...";
+    while(!stopped.load() && !bus.interface()->registeredServiceNames().value().contains(OXIDE_SERVICE)){
+        QThread::sleep(1);
+    }
+}
+
+int record(const QString& path, int duration){
+    Recorder recorder;
+    if(!recorder.open()){
+        return EXIT_FAILURE;
+    }
+    qDebug() << "Recording, press Ctrl+C to stop";
+    if(!recorder.record(stopped, duration)){
+        return EXIT_FAILURE;
+    }
+    return recorder.save(path) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int replay(const QString& path, int runs, bool restart, const QString& traceName){
+    Recording recording;
+    if(!recording.load(path)){
+        return EXIT_FAILURE;
+    }
+    qDebug() << "Loaded" << recording.events.size() << "events over" << recording.duration() / 1000 << "ms";
+    Replayer replayer(recording, stopped);
+    if(!replayer.createDevices()){
+        return EXIT_FAILURE;
+    }
+    auto environment = replayer.environment();
+    for(auto& variable : environment){
+        qStdOut << variable << endl;
+    }
+    auto restore = [restart, &environment]{
+        if(restart){
+            restoreDevices(environment);
+        }
+    };
+    if(restart){
+        useDevices(environment);
+    }
+    auto bus = QDBusConnection::systemBus();
+    waitForTarnish(bus);
+    General api(OXIDE_SERVICE, OXIDE_SERVICE_PATH, bus);
+    QDBusObjectPath systemPath = api.requestAPI("system");
+    if(stopped.load() || systemPath.path() == "/"){
+        qDebug() << "Unable to get system API";
+        restore();
+        return EXIT_FAILURE;
+    }
+    System system(OXIDE_SERVICE, systemPath.path(), bus);
+    QObject::connect(&system, &System::gesture, &replayer, &Replayer::gesture);
+    QDBusObjectPath metricsPath = api.requestAPI("metrics");
+    if(metricsPath.path() == "/"){
+        qDebug() << "Unable to get metrics API";
+        restore();
+        return EXIT_FAILURE;
+    }
+    Metrics metrics(OXIDE_SERVICE, metricsPath.path(), bus);
+    if(!traceName.isEmpty()){
+        metrics.setTraceFile(traceName);
+        qDebug() << "Tracing input to" << metrics.traceFile();
+    }
+    uint pid = bus.interface()->servicePid(OXIDE_SERVICE);
+    // Milliseconds of tarnish's CPU time and of replaying for each run
+    QVector<qint64> cpu;
+    QVector<qint64> elapsed;
+    // Frames tarnish's input thread has read for each device so far
+    QMap<QString, qint64> framesRead;
+    // Microseconds of CPU time per frame read for each run
+    QVector<qint64> cpuPerFrame;
+    metrics.reset("input");
+    for(int run = 1; run <= runs && !stopped.load(); run++){
+        auto before = cpuTime(pid);
+        QElapsedTimer timer;
+        timer.start();
+        auto gestures = replayer.replay();
+        auto after = cpuTime(pid);
+        if(before == -1 || after == -1){
+            qDebug() << "Unable to read tarnish's CPU time";
+            break;
+        }
+        cpu.append(after - before);
+        elapsed.append(timer.elapsed());
+        QStringList frames;
+        qint64 runFrames = 0;
+        auto summary = metrics.summary("input").value();
+        for(auto stage : summary.keys()){
+            if(!stage.endsWith(".read")){
+                continue;
+            }
+            auto count = qdbus_cast<QVariantMap>(summary[stage])["count"].toLongLong();
+            frames << stage + " " + QString::number(count - framesRead[stage]);
+            runFrames += count - framesRead[stage];
+            framesRead[stage] = count;
+        }
+        if(runFrames){
+            cpuPerFrame.append(cpu.last() * 1000 / runFrames);
+        }
+        qDebug() << "Run" << run << "of" << runs << "saw" << gestures << "gestures, tarnish used"
+                 << cpu.last() << "ms of CPU and read" << frames.join(", ");
+    }
+    // Milliseconds from the kernel's timestamp to each stage, over every run
+    auto stages = metrics.summary("input").value();
+    if(!traceName.isEmpty()){
+        metrics.setTraceFile("");
+    }
+    restore();
+    if(cpu.isEmpty()){
+        return EXIT_FAILURE;
+    }
+    // tarnish's CPU time per run, and as a share of the time spent replaying
+    qint64 cpuTotal = 0;
+    qint64 elapsedTotal = 0;
+    for(int i = 0; i < cpu.size(); i++){
+        cpuTotal += cpu[i];
+        elapsedTotal += elapsed[i];
+    }
+    auto sortedCpu = cpu;
+    std::sort(sortedCpu.begin(), sortedCpu.end());
+    std::sort(cpuPerFrame.begin(), cpuPerFrame.end());
+    qStdOut << "runs\tcpu min\tcpu p50\tcpu max\tcpu %\tus per frame" << endl;
+    qStdOut << cpu.size()
+            << "\t" << sortedCpu.first()
+            << "\t" << percentile(sortedCpu, 50)
+            << "\t" << sortedCpu.last()
+            << "\t" << (elapsedTotal ? cpuTotal * 100.0 / elapsedTotal : 0.0)
+            << "\t" << (cpuPerFrame.isEmpty() ? 0 : percentile(cpuPerFrame, 50)) << endl;
+    qStdOut << endl << "stage\tcount\tp50\tp90\tp99\tmax" << endl;
+    for(auto stage : stages.keys()){
+        auto summary = qdbus_cast<QVariantMap>(stages[stage]);
+        qStdOut << stage << "\t" << summary["count"].toLongLong()
+                << "\t" << summary["p50"].toDouble()
+                << "\t" << summary["p90"].toDouble()
+                << "\t" << summary["p99"].toDouble()
+                << "\t" << summary["max"].toDouble() << endl;
+    }
+    auto results = replayer.results();
+    if(results.isEmpty()){
+        qDebug() << "No gestures were recognized";
+        return EXIT_SUCCESS;
+    }
+    // Milliseconds from the frame that completed each gesture to the signal
+    // arriving
+    qStdOut << endl << "action\tcount\tmin\tp50\tp90\tp99\tmax" << endl;
+    for(auto action : results.keys()){
+        auto latencies = results[action];
+        std::sort(latencies.begin(), latencies.end());
+        qStdOut << action << "\t" << latencies.size()
+                << "\t" << latencies.first() / 1000.0
+                << "\t" << percentile(latencies, 50) / 1000.0
+                << "\t" << percentile(latencies, 90) / 1000.0
+                << "\t" << percentile(latencies, 99) / 1000.0
+                << "\t" << latencies.last() / 1000.0 << endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+int hold(int runs, bool restart){
+    HoldTester tester(stopped);
+    if(!tester.createDevice()){
+        return EXIT_FAILURE;
+    }
+    auto environment = tester.environment();
+    for(auto& variable : environment){
+        qStdOut << variable << endl;
+    }
+    if(restart){
+        useDevices(environment);
+    }
+    auto bus = QDBusConnection::systemBus();
+    waitForTarnish(bus);
+    General api(OXIDE_SERVICE, OXIDE_SERVICE_PATH, bus);
+    QDBusObjectPath systemPath = api.requestAPI("system");
+    if(stopped.load() || systemPath.path() == "/"){
+        qDebug() << "Unable to get system API";
+        if(restart){
+            restoreDevices(environment);
+        }
+        return EXIT_FAILURE;
+    }
+    System system(OXIDE_SERVICE, systemPath.path(), bus);
+    QObject::connect(&system, &System::keyHeld, &tester, &HoldTester::keyHeld);
+    int failed = 0;
+    for(int run = 1; run <= runs && !stopped.load(); run++){
+        auto count = tester.results().size();
+        auto passed = tester.run();
+        if(!passed){
+            failed++;
+        }
+        auto& fired = tester.results();
+        if(fired.size() > count){
+            qDebug() << "Run" << run << "of" << runs << "held after" << fired.last() << "ms" << (passed ? "" : "FAILED");
+        }else{
+            qDebug() << "Run" << run << "of" << runs << "FAILED";
+        }
+    }
+    if(restart){
+        restoreDevices(environment);
+    }
+    // Milliseconds from pressing the key to tarnish reporting it held
+    auto fired = tester.results();
+    std::sort(fired.begin(), fired.end());
+    qStdOut << "runs\tfailed\tmissed\tshort held\tmin\tp50\tmax" << endl;
+    qStdOut << runs << "\t" << failed
+            << "\t" << tester.missedHolds()
+            << "\t" << tester.spuriousHolds();
+    if(!fired.isEmpty()){
+        qStdOut << "\t" << fired.first()
+                << "\t" << percentile(fired, 50)
+                << "\t" << fired.last();
+    }
+    qStdOut << endl;
+    return failed || stopped.load() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Compares ScreenCodec with the zlib snapshots it replaced, over raw RGB565
+// frames like `cat /dev/fb0 > screen.raw` captures
+int codec(const QString& path, int runs){
+    QStringList files;
+    if(QFileInfo(path).isDir()){
+        QDir dir(path);
+        for(auto& name : dir.entryList(QDir::Files, QDir::Name)){
+            files << dir.filePath(name);
+        }
+    }else{
+        files << path;
+    }
+    QStringList names{"zlib", "screencodec"};
+    // Bytes in and out, and microseconds for each encode and decode
+    QMap<QString, qint64> inputSize;
+    QMap<QString, qint64> outputSize;
+    QMap<QString, QVector<qint64>> encodeTimes;
+    QMap<QString, QVector<qint64>> decodeTimes;
+    int frames = 0;
+    for(auto& file : files){
+        QFile input(file);
+        if(!input.open(QIODevice::ReadOnly)){
+            qDebug() << "Unable to read" << file << input.errorString();
+            return EXIT_FAILURE;
+        }
+        auto frame = input.readAll();
+        if(frame.isEmpty() || frame.size() % sizeof(uint16_t)){
+            qDebug() << "Skipping" << file << ", it isn't an RGB565 frame";
+            continue;
+        }
+        frames++;
+        auto pixels = (const uint16_t*)frame.constData();
+        size_t count = frame.size() / sizeof(uint16_t);
+        // Stands in for the framebuffer snapshots are restored to
+        QByteArray screen(frame.size(), 0);
+        for(int run = 0; run < runs && !stopped.load(); run++){
+            for(auto& name : names){
+                QElapsedTimer timer;
+                timer.start();
+                QByteArray encoded;
+                if(name == "zlib"){
+                    encoded = qCompress(frame);
+                }else{
+                    encoded = ScreenCodec::encode(pixels, count);
+                }
+                encodeTimes[name].append(timer.nsecsElapsed() / 1000);
+                timer.restart();
+                bool decoded;
+                if(name == "zlib"){
+                    auto data = qUncompress(encoded);
+                    decoded = data.size() == screen.size();
+                    if(decoded){
+                        memcpy(screen.data(), data.constData(), data.size());
+                    }
+                }else{
+                    decoded = ScreenCodec::decode(encoded, (uint16_t*)screen.data(), count);
+                }
+                decodeTimes[name].append(timer.nsecsElapsed() / 1000);
+                if(!decoded || screen != frame){
+                    qDebug() << name << "didn't restore" << file;
+                    return EXIT_FAILURE;
+                }
+                if(!run){
+                    inputSize[name] += frame.size();
+                    outputSize[name] += encoded.size();
+                }
+            }
+        }
+    }
+    if(!frames){
+        qDebug() << "No frames in" << path;
+        return EXIT_FAILURE;
+    }
+    // Times in milliseconds
+    qStdOut << "codec\tframes\tratio\tencode p50\tencode max\tdecode p50\tdecode max" << endl;
+    for(auto& name : names){
+        auto encode = encodeTimes[name];
+        auto decode = decodeTimes[name];
+        std::sort(encode.begin(), encode.end());
+        std::sort(decode.begin(), decode.end());
+        qStdOut << name << "\t" << frames
+                << "\t" << (double)inputSize[name] / outputSize[name]
+                << "\t" << percentile(encode, 50) / 1000.0
+                << "\t" << encode.last() / 1000.0
+                << "\t" << percentile(decode, 50) / 1000.0
+                << "\t" << decode.last() / 1000.0 << endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Runs the touchscreen events in a recording through TouchTracker and the
+// tracker it replaced, without tarnish or any devices
+int tracker(const QString& path, int runs){
+    Recording recording;
+    if(!recording.load(path)){
+        return EXIT_FAILURE;
+    }
+    QVector<input_event> events;
+    int slotCount = 0;
+    for(int index = 0; index < recording.devices.size(); index++){
+        auto& device = recording.devices[index];
+        if(device.role != RecordedDevice::Touch){
+            continue;
+        }
+        if(device.hasBit(device.absBits, ABS_MT_SLOT)){
+            slotCount = device.absInfo[ABS_MT_SLOT].maximum + 1;
+        }
+        for(auto& recorded : recording.events){
+            if(recorded.device == index){
+                input_event event;
+                memset(&event, 0, sizeof(event));
+                event.type = recorded.type;
+                event.code = recorded.code;
+                event.value = recorded.value;
+                events.append(event);
+            }
+        }
+        break;
+    }
+    if(events.isEmpty()){
+        qDebug() << "No touchscreen events in" << path;
+        return EXIT_FAILURE;
+    }
+    QStringList names{"legacy", "touchtracker"};
+    // Frames seen and how many had a contact down, from the first run
+    QMap<QString, int> frames;
+    QMap<QString, int> touching;
+    // Nanoseconds per frame for each run
+    QMap<QString, QVector<qint64>> times;
+    for(int run = 0; run < runs && !stopped.load(); run++){
+        for(auto& name : names){
+            int count = 0;
+            int down = 0;
+            QElapsedTimer timer;
+            timer.start();
+            if(name == "legacy"){
+                LegacyTouchTracker legacy;
+                for(auto& event : events){
+                    if(legacy.handle(event)){
+                        count++;
+                        down += legacy.active() > 0;
+                    }
+                }
+            }else{
+                TouchTracker touches(slotCount);
+                for(auto& event : events){
+                    if(touches.handle(event)){
+                        count++;
+                        down += touches.active() != 0;
+                    }
+                }
+            }
+            auto elapsed = timer.nsecsElapsed();
+            if(!count){
+                qDebug() << "No frames in" << path;
+                return EXIT_FAILURE;
+            }
+            times[name].append(elapsed / count);
+            if(!run){
+                frames[name] = count;
+                touching[name] = down;
+            }
+        }
+    }
+    if(times.isEmpty()){
+        return EXIT_FAILURE;
+    }
+    if(touching["legacy"] != touching["touchtracker"]){
+        qDebug() << "Trackers disagree on how many frames had a contact down";
+    }
+    // Times in nanoseconds per frame
+    qStdOut << "tracker\tframes\tdown\tmin\tp50\tmax" << endl;
+    for(auto& name : names){
+        auto sorted = times[name];
+        std::sort(sorted.begin(), sorted.end());
+        qStdOut << name << "\t" << frames[name]
+                << "\t" << touching[name]
+                << "\t" << sorted.first()
+                << "\t" << percentile(sorted, 50)
+                << "\t" << sorted.last() << endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]){
+    signal(SIGINT, unixSignalHandler);
+    signal(SIGTERM, unixSignalHandler);
+    QCoreApplication app(argc, argv);
+    app.setOrganizationName("Eeems");
+    app.setOrganizationDomain(OXIDE_SERVICE);
+    app.setApplicationName("patina");
+    app.setApplicationVersion(OXIDE_INTERFACE_VERSION);
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Record and replay input for testing gestures\n\n"
+        "Replaying creates virtual copies of the recorded devices. Tarnish\n"
+        "reads them when started with the printed environment variables,\n"
+        "which --restart will do through systemd.\n\n"
+        "Each replay reports the CPU time tarnish used while it ran, also per\n"
+        "frame it read, and how long its input stages took, so builds can be\n"
+        "compared on the same recording. --trace keeps every sample it timed.\n\n"
+        "hold checks that a button held past " QT_STRINGIFY(HOLD_TIME) " ms is reported\n"
+        "within " QT_STRINGIFY(HOLD_TOLERANCE) " ms of it, and that a short press isn't.\n\n"
+        "codec compares the codec paused applications' screens are saved with\n"
+        "against the zlib compression it replaced, over captured frames.\n\n"
+        "tracker times how long tarnish's touch tracker and the one it replaced\n"
+        "take per frame of a recording, without needing tarnish."
+    );
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("action", "record\nreplay\nhold\ncodec\ntracker");
+    parser.addPositionalArgument("file", "Recording to write or read, or a raw RGB565 frame or folder of them for codec.");
+    QCommandLineOption durationOption(
+        {"d", "duration"},
+        "Stop recording after this many seconds.",
+        "seconds"
+    );
+    parser.addOption(durationOption);
+    QCommandLineOption runsOption(
+        {"n", "runs"},
+        "Number of times to replay the recording, hold the button, code each frame or run the trackers.",
+        "runs",
+        "10"
+    );
+    parser.addOption(runsOption);
+    QCommandLineOption restartOption(
+        "restart",
+        "Restart tarnish to use the virtual devices while replaying or holding."
+    );
+    parser.addOption(restartOption);
+    QCommandLineOption traceOption(
+        "trace",
+        "Have tarnish write its input metrics to this file in its trace directory while replaying.",
+        "name"
+    );
+    parser.addOption(traceOption);
+    parser.process(app);
+
+    auto args = parser.positionalArguments();
+    if(args.isEmpty()){
+        parser.showHelp(EXIT_FAILURE);
+    }
+    auto action = args.at(0);
+    if(action == "hold"){
+        auto runs = parser.value(runsOption).toInt();
+        if(runs < 1){
+            qDebug() << "Invalid number of runs" << parser.value(runsOption);
+            return EXIT_FAILURE;
+        }
+        return hold(runs, parser.isSet(restartOption));
+    }
+    if(args.size() < 2){
+        parser.showHelp(EXIT_FAILURE);
+    }
+    if(action == "record"){
+        auto duration = parser.isSet(durationOption) ? parser.value(durationOption).toInt() * 1000 : -1;
+        return record(args.at(1), duration);
+    }
+    if(action == "codec"){
+        auto runs = parser.value(runsOption).toInt();
+        if(runs < 1){
+            qDebug() << "Invalid number of runs" << parser.value(runsOption);
+            return EXIT_FAILURE;
+        }
+        return codec(args.at(1), runs);
+    }
+    if(action == "tracker"){
+        auto runs = parser.value(runsOption).toInt();
+        if(runs < 1){
+            qDebug() << "Invalid number of runs" << parser.value(runsOption);
+            return EXIT_FAILURE;
+        }
+        return tracker(args.at(1), runs);
+    }
+    if(action == "replay"){
+        auto runs = parser.value(runsOption).toInt();
+        if(runs < 1){
+            qDebug() << "Invalid number of runs" << parser.value(runsOption);
+            return EXIT_FAILURE;
+        }
+        return replay(args.at(1), runs, parser.isSet(restartOption), parser.value(traceOption));
+    }
+    parser.showHelp(EXIT_FAILURE);
+}
@@ -0,0 +1,33 @@
+QT -= gui
+QT += dbus
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+# You can make your code fail to compile if it uses deprecated APIs.
+# In order to do so, uncomment the following line.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+SOURCES += \
+        main.cpp \
+        ../../shared/devicesettings.cpp
+
+# Default rules for deployment.
+target.path = /opt/bin
+!isEmpty(target.path): INSTALLS += target
+
+DBUS_INTERFACES += ../../interfaces/dbusservice.xml
+DBUS_INTERFACES += ../../interfaces/systemapi.xml
+DBUS_INTERFACES += ../../interfaces/metricsapi.xml
+
+INCLUDEPATH += ../../shared
+HEADERS += \
+    recorder.h \
+    recording.h \
+    replayer.h \
+    holdtester.h \
+    legacytouchtracker.h \
+    ../../shared/dbussettings.h \
+    ../../shared/devicesettings.h \
+    ../../shared/screencodec.h \
+    ../../shared/touchtracker.h
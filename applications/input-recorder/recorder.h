@@ -0,0 +1,120 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <QDebug>
+#include <QList>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <poll.h>
+#include <time.h>
+
+#include "recording.h"
+#include "devicesettings.h"
+
+// Events pulled from a device per read()
+#define RECORDER_READ_SIZE 64
+
+// Reads the touchscreen, wacom and button devices until stopped, keeping
+// the kernel's timestamp for every event.
+class Recorder {
+public:
+    Recorder() : fds(), lastTime(-1) {}
+    ~Recorder(){
+        for(auto fd : fds){
+            close(fd);
+        }
+    }
+    bool open(){
+        const QList<QPair<RecordedDevice::Role, const char*>> paths{
+            {RecordedDevice::Touch, deviceSettings.getTouchDevicePath()},
+            {RecordedDevice::Wacom, deviceSettings.getWacomDevicePath()},
+            {RecordedDevice::Buttons, deviceSettings.getButtonsDevicePath()},
+        };
+        for(auto& item : paths){
+            auto fd = ::open(item.second, O_RDONLY | O_NONBLOCK);
+            if(fd == -1){
+                qDebug() << "Failed to open event device:" << item.second;
+                return false;
+            }
+            fds.append(fd);
+            RecordedDevice device;
+            if(!RecordedDevice::fromDevice(fd, item.first, device)){
+                qDebug() << "Failed to read capabilities of" << item.second;
+                return false;
+            }
+            qDebug() << "Recording" << RecordedDevice::roleName(item.first) << "from" << item.second << device.name;
+            recording.devices.append(device);
+        }
+        return true;
+    }
+    // Returns once stopped is set or after duration milliseconds, -1 for no limit
+    bool record(std::atomic<bool>& stopped, int duration = -1){
+        QVector<pollfd> pfds;
+        for(auto fd : fds){
+            pfds.append(pollfd{fd, POLLIN, 0});
+        }
+        timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while(!stopped.load()){
+            auto timeout = -1;
+            if(duration >= 0){
+                timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                auto elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+                if(elapsed >= duration){
+                    break;
+                }
+                timeout = duration - elapsed;
+            }
+            auto res = ::poll(pfds.data(), pfds.size(), timeout);
+            if(res < 0){
+                if(errno == EINTR){
+                    continue;
+                }
+                qDebug() << "Failed to poll input devices" << strerror(errno);
+                return false;
+            }
+            for(int i = 0; i < pfds.size(); i++){
+                if(pfds[i].revents & POLLIN){
+                    readDevice(i);
+                }
+            }
+        }
+        return true;
+    }
+    bool save(const QString& path){
+        qDebug() << "Recorded" << recording.events.size() << "events over" << recording.duration() / 1000 << "ms";
+        return recording.save(path);
+    }
+
+private:
+    QList<int> fds;
+    Recording recording;
+    qint64 lastTime;
+
+    void readDevice(int index){
+        input_event events[RECORDER_READ_SIZE];
+        ssize_t size;
+        while((size = ::read(fds[index], events, sizeof(events))) > 0){
+            for(size_t i = 0; i < size / sizeof(input_event); i++){
+                auto& event = events[i];
+                qint64 time = (qint64)event.time.tv_sec * 1000000 + event.time.tv_usec;
+                // Devices are read one after the other, so time can go backwards
+                // a little between them
+                auto delta = lastTime == -1 ? 0 : qBound((qint64)0, time - lastTime, (qint64)UINT32_MAX);
+                lastTime = std::max(lastTime, time);
+                recording.events.append(RecordedEvent{
+                    .delta = (quint32)delta,
+                    .device = (quint8)index,
+                    .type = event.type,
+                    .code = event.code,
+                    .value = event.value,
+                });
+            }
+        }
+    }
+};
+
+#endif // RECORDER_H
@@ -0,0 +1,182 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <QFile>
+#include <QDataStream>
+#include <QDebug>
+#include <QVector>
+
+#include <cstring>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define RECORDING_MAGIC 0x4f584952 // OXIR
+#define RECORDING_VERSION 1
+// The device index is kept in the top byte of the event type
+#define RECORDING_DEVICE_SHIFT 8
+
+struct RecordedDevice {
+    enum Role { Touch, Wacom, Buttons };
+    quint8 role = Touch;
+    QString name;
+    input_id id;
+    QByteArray evBits;
+    QByteArray keyBits;
+    QByteArray absBits;
+    QByteArray propBits;
+    QVector<input_absinfo> absInfo;
+
+    bool hasBit(const QByteArray& bits, int bit) const{
+        return bit / 8 < bits.size() && bits[bit / 8] & (1 << (bit % 8));
+    }
+    static QString roleName(int role){
+        switch(role){
+            case Touch: return "touch";
+            case Wacom: return "wacom";
+            case Buttons: return "buttons";
+            default: return "unknown";
+        }
+    }
+    // Read everything needed to create an identical uinput device later
+    static bool fromDevice(int fd, Role role, RecordedDevice& device){
+        char name[256];
+        memset(name, 0, sizeof(name));
+        device.role = role;
+        device.evBits.fill(0, EV_CNT / 8 + 1);
+        device.keyBits.fill(0, KEY_CNT / 8 + 1);
+        device.absBits.fill(0, ABS_CNT / 8 + 1);
+        device.propBits.fill(0, INPUT_PROP_CNT / 8 + 1);
+        if(
+            ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name) == -1
+            || ioctl(fd, EVIOCGID, &device.id) == -1
+            || ioctl(fd, EVIOCGBIT(0, device.evBits.size()), device.evBits.data()) == -1
+            || ioctl(fd, EVIOCGBIT(EV_KEY, device.keyBits.size()), device.keyBits.data()) == -1
+            || ioctl(fd, EVIOCGBIT(EV_ABS, device.absBits.size()), device.absBits.data()) == -1
+            || ioctl(fd, EVIOCGPROP(device.propBits.size()), device.propBits.data()) == -1
+        ){
+            return false;
+        }
+        device.name = name;
+        device.absInfo.fill(input_absinfo{}, ABS_CNT);
+        for(int i = 0; i < ABS_CNT; i++){
+            if(device.hasBit(device.absBits, i) && ioctl(fd, EVIOCGABS(i), &device.absInfo[i]) == -1){
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// A recorded event is 12 bytes: the time since the previous event in
+// microseconds, the device index and type, the code and the value.
+struct RecordedEvent {
+    quint32 delta;
+    quint8 device;
+    quint16 type;
+    quint16 code;
+    qint32 value;
+};
+
+inline QDataStream& operator<<(QDataStream& stream, const RecordedDevice& device){
+    stream << device.role << device.name
+           << device.id.bustype << device.id.vendor << device.id.product << device.id.version
+           << device.evBits << device.keyBits << device.absBits << device.propBits;
+    for(int i = 0; i < ABS_CNT; i++){
+        if(device.hasBit(device.absBits, i)){
+            auto& info = device.absInfo[i];
+            stream << info.value << info.minimum << info.maximum << info.fuzz << info.flat << info.resolution;
+        }
+    }
+    return stream;
+}
+inline QDataStream& operator>>(QDataStream& stream, RecordedDevice& device){
+    stream >> device.role >> device.name
+           >> device.id.bustype >> device.id.vendor >> device.id.product >> device.id.version
+           >> device.evBits >> device.keyBits >> device.absBits >> device.propBits;
+    device.absInfo.fill(input_absinfo{}, ABS_CNT);
+    for(int i = 0; i < ABS_CNT; i++){
+        if(device.hasBit(device.absBits, i)){
+            auto& info = device.absInfo[i];
+            stream >> info.value >> info.minimum >> info.maximum >> info.fuzz >> info.flat >> info.resolution;
+        }
+    }
+    return stream;
+}
+inline QDataStream& operator<<(QDataStream& stream, const RecordedEvent& event){
+    return stream << event.delta << (quint16)(event.type | event.device << RECORDING_DEVICE_SHIFT) << event.code << event.value;
+}
+inline QDataStream& operator>>(QDataStream& stream, RecordedEvent& event){
+    quint16 type;
+    stream >> event.delta >> type >> event.code >> event.value;
+    event.device = type >> RECORDING_DEVICE_SHIFT;
+    event.type = type & ((1 << RECORDING_DEVICE_SHIFT) - 1);
+    return stream;
+}
+
+class Recording {
+public:
+    QVector<RecordedDevice> devices;
+    QVector<RecordedEvent> events;
+
+    bool save(const QString& path){
+        QFile file(path);
+        if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)){
+            qDebug() << "Unable to open" << path << file.errorString();
+            return false;
+        }
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_5_0);
+        stream << (quint32)RECORDING_MAGIC << (quint16)RECORDING_VERSION << (quint16)devices.size();
+        for(auto& device : devices){
+            stream << device;
+        }
+        stream << (quint32)events.size();
+        for(auto& event : events){
+            stream << event;
+        }
+        return stream.status() == QDataStream::Ok;
+    }
+    bool load(const QString& path){
+        QFile file(path);
+        if(!file.open(QIODevice::ReadOnly)){
+            qDebug() << "Unable to open" << path << file.errorString();
+            return false;
+        }
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_5_0);
+        quint32 magic;
+        quint16 version;
+        quint16 deviceCount;
+        stream >> magic >> version >> deviceCount;
+        if(magic != RECORDING_MAGIC || version != RECORDING_VERSION){
+            qDebug() << path << "is not a recording this version can read";
+            return false;
+        }
+        devices.resize(deviceCount);
+        for(auto& device : devices){
+            stream >> device;
+        }
+        quint32 eventCount;
+        stream >> eventCount;
+        events.resize(eventCount);
+        for(auto& event : events){
+            stream >> event;
+            if(event.device >= devices.size()){
+                qDebug() << "Event for unknown device" << event.device;
+                return false;
+            }
+        }
+        return stream.status() == QDataStream::Ok;
+    }
+    qint64 duration() const{
+        qint64 total = 0;
+        for(auto& event : events){
+            total += event.delta;
+        }
+        return total;
+    }
+};
+
+#endif // RECORDING_H
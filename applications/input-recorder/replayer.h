@@ -0,0 +1,259 @@
+#ifndef REPLAYER_H
+#define REPLAYER_H
+
+#include <QObject>
+#include <QDebug>
+#include <QDir>
+#include <QMap>
+#include <QVector>
+#include <QThread>
+#include <QTimer>
+#include <QEventLoop>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <atomic>
+#include <time.h>
+#include <linux/uinput.h>
+
+#include "recording.h"
+
+// How long to keep listening for gestures after the last event of a run
+#define REPLAY_SETTLE_TIME 1000
+// Most microseconds between stamping a frame and the kernel stamping its
+// events for them to still be matched
+#define REPLAY_MATCH_WINDOW 2000
+
+// A uinput device with the same capabilities as a recorded one
+class VirtualDevice {
+public:
+    VirtualDevice() : fd(-1), m_path() {}
+    ~VirtualDevice(){
+        if(fd != -1){
+            ioctl(fd, UI_DEV_DESTROY);
+            close(fd);
+        }
+    }
+    bool create(const RecordedDevice& device){
+        fd = ::open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+        if(fd == -1){
+            qDebug() << "Unable to open /dev/uinput" << strerror(errno);
+            return false;
+        }
+        for(int i = 0; i < EV_CNT; i++){
+            if(device.hasBit(device.evBits, i)){
+                ioctl(fd, UI_SET_EVBIT, i);
+            }
+        }
+        for(int i = 0; i < KEY_CNT; i++){
+            if(device.hasBit(device.keyBits, i)){
+                ioctl(fd, UI_SET_KEYBIT, i);
+            }
+        }
+        for(int i = 0; i < INPUT_PROP_CNT; i++){
+            if(device.hasBit(device.propBits, i)){
+                ioctl(fd, UI_SET_PROPBIT, i);
+            }
+        }
+        for(int i = 0; i < ABS_CNT; i++){
+            if(device.hasBit(device.absBits, i)){
+                ioctl(fd, UI_SET_ABSBIT, i);
+                uinput_abs_setup setup;
+                memset(&setup, 0, sizeof(setup));
+                setup.code = i;
+                setup.absinfo = device.absInfo[i];
+                if(ioctl(fd, UI_ABS_SETUP, &setup) == -1){
+                    qDebug() << "Unable to setup axis" << i << strerror(errno);
+                    return false;
+                }
+            }
+        }
+        uinput_setup setup;
+        memset(&setup, 0, sizeof(setup));
+        setup.id = device.id;
+        strncpy(setup.name, ("patina: " + device.name).toStdString().c_str(), UINPUT_MAX_NAME_SIZE - 1);
+        if(ioctl(fd, UI_DEV_SETUP, &setup) == -1 || ioctl(fd, UI_DEV_CREATE) == -1){
+            qDebug() << "Unable to create virtual device" << strerror(errno);
+            return false;
+        }
+        char sysname[64];
+        memset(sysname, 0, sizeof(sysname));
+        if(ioctl(fd, UI_GET_SYSNAME(sizeof(sysname) - 1), sysname) == -1){
+            qDebug() << "Unable to find virtual device" << strerror(errno);
+            return false;
+        }
+        QDir sys(QString("/sys/devices/virtual/input/") + sysname);
+        auto nodes = sys.entryList(QStringList() << "event*", QDir::Dirs);
+        if(nodes.isEmpty()){
+            qDebug() << "No event device for" << sys.path();
+            return false;
+        }
+        m_path = "/dev/input/" + nodes.first();
+        // udev creates the node in the background
+        for(int i = 0; i < 100 && !QFileInfo::exists(m_path); i++){
+            QThread::msleep(10);
+        }
+        return true;
+    }
+    const QString& path(){ return m_path; }
+    bool write(const input_event* events, size_t count){
+        return ::write(fd, events, count * sizeof(input_event)) == (ssize_t)(count * sizeof(input_event));
+    }
+
+private:
+    int fd;
+    QString m_path;
+};
+
+// Plays a recording through virtual devices, timing how long after the frame
+// that caused it tarnish reports a gesture.
+//
+// Every frame's write time is stamped for the run. tarnish passes on the
+// kernel's timestamp of the event that completed the gesture, which is
+// matched back to the frame written just before it. Gestures completed by a
+// deadline instead of a frame, like a long press, are timed from the deadline.
+class Replayer : public QObject {
+    Q_OBJECT
+public:
+    Replayer(Recording& recording, std::atomic<bool>& stopped, QObject* parent = nullptr)
+    : QObject(parent),
+      recording(recording),
+      stopped(stopped),
+      devices(),
+      injected(),
+      injectedCount(0),
+      latencies(),
+      runGestures(0) {}
+    ~Replayer(){
+        qDeleteAll(devices);
+    }
+    bool createDevices(){
+        for(auto& recorded : recording.devices){
+            auto device = new VirtualDevice();
+            devices.append(device);
+            if(!device->create(recorded)){
+                return false;
+            }
+        }
+        return true;
+    }
+    // Environment to point tarnish at the virtual devices
+    QStringList environment(){
+        QStringList result;
+        for(int i = 0; i < devices.size(); i++){
+            switch(recording.devices[i].role){
+                case RecordedDevice::Touch:
+                    result << "OXIDE_TOUCH_DEVICE=" + devices[i]->path();
+                break;
+                case RecordedDevice::Wacom:
+                    result << "OXIDE_WACOM_DEVICE=" + devices[i]->path();
+                break;
+                case RecordedDevice::Buttons:
+                    result << "OXIDE_BUTTONS_DEVICE=" + devices[i]->path();
+                break;
+            }
+        }
+        return result;
+    }
+    // Returns the number of gestures seen during the run
+    int replay(){
+        QEventLoop loop;
+        runGestures = 0;
+        injectedCount.store(0);
+        int frames = 0;
+        for(auto& recorded : recording.events){
+            if(recorded.type == EV_SYN && recorded.code == SYN_REPORT){
+                frames++;
+            }
+        }
+        injected.fill(0, frames);
+        auto thread = QThread::create([this]{ inject(); });
+        connect(thread, &QThread::finished, &loop, [&loop]{
+            QTimer::singleShot(REPLAY_SETTLE_TIME, &loop, &QEventLoop::quit);
+        });
+        thread->start();
+        loop.exec();
+        thread->wait();
+        delete thread;
+        return runGestures;
+    }
+    // Latency in microseconds for every gesture seen, by action
+    const QMap<QString, QVector<qint64>>& results(){ return latencies; }
+
+public slots:
+    // timestamp is from the event that completed the gesture, in
+    // CLOCK_MONOTONIC microseconds
+    void gesture(QString action, qlonglong timestamp){
+        auto received = now();
+        auto count = injectedCount.load(std::memory_order_acquire);
+        if(!count || timestamp < injected[0]){
+            qDebug() << "Gesture" << action << "wasn't caused by this run";
+            return;
+        }
+        // The newest frame written before the event was stamped
+        auto frame = *(std::upper_bound(injected.constBegin(), injected.constBegin() + count, timestamp) - 1);
+        auto from = timestamp - frame <= REPLAY_MATCH_WINDOW ? frame : timestamp;
+        latencies[action].append(received - from);
+        runGestures++;
+    }
+
+private:
+    Recording& recording;
+    std::atomic<bool>& stopped;
+    QList<VirtualDevice*> devices;
+    // When each frame of the current run was written, in CLOCK_MONOTONIC
+    // microseconds. Only the first injectedCount are valid.
+    QVector<qint64> injected;
+    std::atomic<int> injectedCount;
+    QMap<QString, QVector<qint64>> latencies;
+    int runGestures;
+
+    static qint64 now(){
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return (qint64)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+    }
+    void inject(){
+        QVector<QVector<input_event>> frames(devices.size());
+        timespec target;
+        clock_gettime(CLOCK_MONOTONIC, &target);
+        for(auto& recorded : recording.events){
+            if(stopped.load()){
+                return;
+            }
+            // Keep to the recorded schedule instead of sleeping for each delta,
+            // so time spent writing doesn't add up over a run
+            target.tv_sec += recorded.delta / 1000000;
+            target.tv_nsec += (recorded.delta % 1000000) * 1000;
+            if(target.tv_nsec >= 1000000000){
+                target.tv_sec++;
+                target.tv_nsec -= 1000000000;
+            }
+            if(recorded.type == EV_SYN && recorded.code == SYN_DROPPED){
+                frames[recorded.device].clear();
+                continue;
+            }
+            input_event event;
+            memset(&event, 0, sizeof(event));
+            event.type = recorded.type;
+            event.code = recorded.code;
+            event.value = recorded.value;
+            auto& frame = frames[recorded.device];
+            frame.append(event);
+            if(event.type != EV_SYN || event.code != SYN_REPORT){
+                continue;
+            }
+            while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, nullptr) == EINTR){}
+            // Before writing, the kernel stamps the events while they're written
+            auto count = injectedCount.load(std::memory_order_relaxed);
+            injected[count] = now();
+            if(!devices[recorded.device]->write(frame.data(), frame.size())){
+                qDebug() << "Failed to write to" << devices[recorded.device]->path() << strerror(errno);
+            }
+            injectedCount.store(count + 1, std::memory_order_release);
+            frame.clear();
+        }
+    }
+};
+
+#endif // REPLAYER_H
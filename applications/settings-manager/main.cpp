@@ -18,6 +18,7 @@
 #include "screenshot_interface.h"
 #include "notificationapi_interface.h"
 #include "notification_interface.h"
+#include "metricsapi_interface.h"
 
 using namespace codes::eeems::oxide1;
 
@@ -206,7 +207,7 @@ int main(int argc, char *argv[]){
     parser.addHelpOption();
     parser.applicationDescription();
     parser.addVersionOption();
-    parser.addPositionalArgument("api", "wifi\npower\napps\nsystem\nscreen\nnotification");
+    parser.addPositionalArgument("api", "wifi\npower\napps\nsystem\nscreen\nnotification\nmetrics");
     parser.addPositionalArgument("action","get\nset\nlisten\ncall");
     QCommandLineOption objectOption(
         {"o", "object"},
@@ -227,7 +228,7 @@ int main(int argc, char *argv[]){
         parser.showHelp(EXIT_FAILURE);
     }
     auto apiName = args.at(0);
-    if(!(QSet<QString> {"power", "wifi", "apps", "system", "screen", "notification"}).contains(apiName)){
+    if(!(QSet<QString> {"power", "wifi", "apps", "system", "screen", "notification", "metrics"}).contains(apiName)){
         qDebug() << "Unknown API" << apiName;
         return EXIT_FAILURE;
     }
@@ -356,6 +357,12 @@ int main(int argc, char *argv[]){
                 return EXIT_FAILURE;
             }
         }
+    }else if(apiName == "metrics"){
+        api = new Metrics(OXIDE_SERVICE, path, bus);
+        if(parser.isSet("object")){
+            qDebug() << "Paths are not valid for the metrics API";
+            return EXIT_FAILURE;
+        }
     }else{
         qDebug() << "API not initialized? Please log a bug.";
         return EXIT_FAILURE;
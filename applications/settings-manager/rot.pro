@@ -32,6 +32,7 @@ DBUS_INTERFACES += ../../interfaces/screenapi.xml
 DBUS_INTERFACES += ../../interfaces/screenshot.xml
 DBUS_INTERFACES += ../../interfaces/notificationapi.xml
 DBUS_INTERFACES += ../../interfaces/notification.xml
+DBUS_INTERFACES += ../../interfaces/metricsapi.xml
 
 # Default rules for deployment.
 target.path = /opt/bin
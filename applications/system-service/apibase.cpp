@@ -1,22 +1,38 @@
 #include "apibase.h"
 #include "appsapi.h"
 
+//#define DEBUG_PERMISSIONS
+
+QHash<QString, pid_t> APIBase::senderProcessGroups;
+
 int APIBase::hasPermission(QString permission, const char* sender){
-    if(getpgid(getpid()) == getSenderPgid()){
+    static pid_t pgid = getpgid(getpid());
+    auto senderPgid = getSenderPgid();
+    if(pgid == senderPgid){
         return true;
     }
-    qDebug() << "Checking permission" << permission << "from" << sender;
-    for(auto name : appsAPI->runningApplicationsNoSecurityCheck().keys()){
-        auto app = appsAPI->getApplication(name);
-        if(app == nullptr){
-            continue;
-        }
-        if(app->processId() == getSenderPgid()){
-            auto result = app->permissions().contains(permission);
-            qDebug() << app->name() << result;
-            return result;
+    auto app = appsAPI->getApplicationForProcessGroup(senderPgid);
+    if(app == nullptr){
+#ifdef DEBUG_PERMISSIONS
+        qDebug() << "Checking permission" << permission << "from" << sender << "app not found, permission granted";
+#endif
+        return true;
+    }
+    auto result = app->hasPermissionNoSecurityCheck(permission);
+#ifdef DEBUG_PERMISSIONS
+    qDebug() << "Checking permission" << permission << "from" << sender << app->name() << result;
+#else
+    Q_UNUSED(sender);
+#endif
+    return result;
+}
+
+void APIBase::forgetProcessGroup(pid_t pgid){
+    for(auto it = senderProcessGroups.begin(); it != senderProcessGroups.end();){
+        if(it.value() == pgid){
+            it = senderProcessGroups.erase(it);
+        }else{
+            ++it;
         }
     }
-    qDebug() << "app not found, permission granted";
-    return true;
 }
@@ -6,6 +6,7 @@
 #include <QDBusConnection>
 #include <QDBusConnectionInterface>
 #include <QDBusMessage>
+#include <QHash>
 
 #include <unistd.h>
 
@@ -18,6 +19,10 @@ public:
     APIBase(QObject* parent) : QObject(parent) {}
     virtual void setEnabled(bool enabled) = 0;
     int hasPermission(QString permission, const char* sender = __builtin_FUNCTION());
+    // Forget cached process groups for a D-Bus name that left the bus
+    static void forgetSender(const QString& name){ senderProcessGroups.remove(name); }
+    // Forget cached senders that belong to a process group that has exited
+    static void forgetProcessGroup(pid_t pgid);
 
 protected:
     int getSenderPid(){
@@ -26,7 +31,26 @@ protected:
         }
         return connection().interface()->servicePid(message().service());
     }
-    int getSenderPgid(){ return getpgid(getSenderPid()); }
+    int getSenderPgid(){
+        if(!calledFromDBus()){
+            return getpgid(getpid());
+        }
+        // Unique names are never reused by the bus, so the process group
+        // only has to be resolved once per connection
+        auto name = message().service();
+        auto it = senderProcessGroups.constFind(name);
+        if(it != senderProcessGroups.constEnd()){
+            return it.value();
+        }
+        pid_t pgid = getpgid(connection().interface()->servicePid(name));
+        if(pgid != -1){
+            senderProcessGroups.insert(name, pgid);
+        }
+        return pgid;
+    }
+
+private:
+    static QHash<QString, pid_t> senderProcessGroups;
 };
 
 #endif // APIBASE_H
@@ -19,32 +19,82 @@ void Application::launch(){
     launchNoSecurityCheck();
 }
 void Application::launchNoSecurityCheck(){
-    if(m_process->processId()){
+    if(processId()){
         resumeNoSecurityCheck();
-    }else{
-        appsAPI->recordPreviousApplication();
-        qDebug() << "Launching " << path();
-        appsAPI->pauseAll();
+        return;
+    }
+    m_launchRequestTimer.start();
+    appsAPI->recordPreviousApplication();
+    qDebug() << "Launching " << path();
+    appsAPI->pauseAll();
+    // Don't draw the splash screen until everything else has let go of it
+    appsAPI->afterTransitions([this]{
+        if(processId()){
+            return;
+        }
         if(!flags().contains("nosplash")){
             showSplashScreen();
         }
-        if(m_process->program() != bin()){
-            m_process->setProgram(bin());
-        }
-        updateEnvironment();
-        umountAll();
-        if(chroot()){
+        startProcess();
+        m_process->waitForStarted();
+    });
+}
+void Application::autoStartNoSecurityCheck(){
+    if(processId()){
+        return;
+    }
+    qDebug() << "Auto starting" << name();
+    m_launchRequestTimer.invalidate();
+    // Don't let it take over the screen, send it to the background as soon as
+    // it's able to handle the signal, or stop it if it can't be backgrounded
+    m_backgroundWhenReady = type() == AppsAPI::Backgroundable;
+    m_pauseWhenStarted = type() == AppsAPI::Foreground;
+    startProcess();
+}
+void Application::startProcess(){
+    m_launchTimer.start();
+    if(m_primed && m_process->waitForStarted()){
+        // Already sandboxed and loaded, it only has to be told to run
+        m_primed = false;
+        m_zygoteLaunch = true;
+        m_process->write(ZYGOTE_LAUNCH);
+        started();
+        return;
+    }
+    m_zygoteLaunch = false;
+    spawn(bin(), QStringList());
+}
+void Application::prime(){
+    if(!zygote() || m_zygoteUnsupported || m_process->processId() || appsAPI->stopping()){
+        return;
+    }
+    qDebug() << "Priming zygote for" << name();
+    m_primed = true;
+    spawn(QCoreApplication::applicationDirPath() + "/" ZYGOTE_BIN, QStringList() << bin());
+}
+void Application::spawn(const QString& program, const QStringList& arguments){
+    m_process->setProgram(program);
+    m_process->setArguments(arguments);
+    updateEnvironment();
+    setupCgroup();
+    if(chroot()){
+        if(!sandboxReady()){
+            umountAll();
             mountAll();
-            m_process->setChroot(chrootPath());
         }else{
-            m_process->setChroot("");
+            resetVolatile();
         }
-        m_process->setWorkingDirectory(workingDirectory());
-        m_process->setUser(user());
-        m_process->setGroup(group());
-        m_process->start();
-        m_process->waitForStarted();
-    }
+        m_process->setChroot(chrootPath());
+    }else{
+        umountAll();
+        m_process->setChroot("");
+    }
+    m_process->setWorkingDirectory(workingDirectory());
+    m_process->setUser(user());
+    m_process->setGroup(group());
+    openLogStreams();
+    m_process->start();
+    closeLogStreams();
 }
 void Application::pause(bool startIfNone){
     if(!hasPermission("apps")){
@@ -53,28 +103,44 @@ void Application::pause(bool startIfNone){
     pauseNoSecurityCheck(startIfNone);
 }
 void Application::pauseNoSecurityCheck(bool startIfNone){
+    if(inTransition()){
+        afterTransition([this, startIfNone]{ pauseNoSecurityCheck(startIfNone); });
+        return;
+    }
     if(
-        !m_process->processId()
+        !processId()
         || stateNoSecurityCheck() == Paused
         || type() == AppsAPI::Background
     ){
         return;
     }
     qDebug() << "Pausing " << path();
+    QElapsedTimer elapsed;
+    elapsed.start();
     interruptApplication();
-    if(!flags().contains("nosavescreen")){
-        saveScreen();
-    }
-    if(startIfNone){
-        appsAPI->resumeIfNone();
-    }
-    emit paused();
-    emit appsAPI->applicationPaused(qPath());
-    qDebug() << "Paused " << path();
+    afterTransition([this, startIfNone, elapsed]{
+        if(!processId()){
+            return;
+        }
+        if(!flags().contains("nosavescreen")){
+            saveScreen();
+        }
+        if(startIfNone){
+            appsAPI->resumeIfNone();
+        }
+        metricsAPI->record(name(), "pause", elapsed);
+        emit paused();
+        emit appsAPI->applicationPaused(qPath());
+        qDebug() << "Paused " << path();
+    });
 }
 void Application::interruptApplication(){
+    if(inTransition()){
+        afterTransition([this]{ interruptApplication(); });
+        return;
+    }
     if(
-        !m_process->processId()
+        !processId()
         || stateNoSecurityCheck() == Paused
         || type() == AppsAPI::Background
     ){
@@ -91,39 +157,130 @@ void Application::interruptApplication(){
             qDebug() << "Waiting for SIGUSR2 ack";
             appsAPI->connectSignals(this, 2);
             kill(-m_process->processId(), SIGUSR2);
-            timer.restart();
-            delayUpTo(1000);
-            appsAPI->disconnectSignals(this, 2);
-            if(stateNoSecurityCheck() == Inactive){
-                qDebug() << "Application crashed while pausing";
-            }else if(timer.isValid()){
-                qDebug() << "Application took too long to background" << name();
-                kill(-m_process->processId(), SIGSTOP);
-                waitForPause();
-            }else{
-                m_backgrounded = true;
-                qDebug() << "SIGUSR2 ack recieved";
-            }
+            beginTransition(WaitingForBackground);
             break;
         case AppsAPI::Foreground:
         default:
-            kill(-m_process->processId(), SIGSTOP);
-            waitForPause();
+            stopProcesses();
+            beginTransition(WaitingForStop);
     }
 }
-void Application::waitForPause(){
-    if(stateNoSecurityCheck() == Paused){
+void Application::afterTransition(std::function<void()> callback){
+    if(!inTransition()){
+        callback();
+        return;
+    }
+    m_transitionCallbacks.append(callback);
+}
+void Application::beginTransition(int transition){
+    m_transition = transition;
+    m_transitionTimer.start();
+    m_transitionElapsed.start();
+}
+void Application::finishTransition(){
+    m_transitionTimer.stop();
+    switch(m_transition){
+        case WaitingForBackground:
+            metricsAPI->record(name(), "background", m_transitionElapsed);
+        break;
+        case WaitingForStop:
+            metricsAPI->record(name(), "stop", m_transitionElapsed);
+        break;
+        case WaitingForForeground:
+            metricsAPI->record(name(), "foreground", m_transitionElapsed);
+        break;
+        case WaitingForContinue:
+            metricsAPI->record(name(), "continue", m_transitionElapsed);
+        break;
+    }
+    m_transition = NoTransition;
+    updateState();
+    // A callback may start another transition, the rest wait for that one
+    while(!inTransition() && !m_transitionCallbacks.isEmpty()){
+        m_transitionCallbacks.takeFirst()();
+    }
+    if(!inTransition()){
+        emit transitionFinished();
+        appsAPI->transitionFinished();
+    }
+}
+void Application::transitionTimeout(){
+    switch(m_transition){
+        case WaitingForBackground:
+            qDebug() << "Application took too long to background" << name();
+            appsAPI->disconnectSignals(this, 2);
+            stopProcesses();
+            beginTransition(WaitingForStop);
+        break;
+        case WaitingForStop:
+            // The stop notification will still update the state when it arrives
+            qDebug() << "Warning: application took too long to stop" << name();
+            finishTransition();
+        break;
+        case WaitingForForeground:
+            // No need to wait any longer, we've just assumed it continued
+            qDebug() << "Warning: application took too long to forground" << name();
+            appsAPI->disconnectSignals(this, 1);
+            m_backgrounded = false;
+            finishTransition();
+        break;
+        case WaitingForContinue:
+            qDebug() << "Warning: application took too long to continue" << name();
+            finishTransition();
+        break;
+    }
+}
+void Application::sigUsr1(int pid){
+    if(m_transition != WaitingForForeground || !isOwnProcess(pid)){
+        return;
+    }
+    qDebug() << "SIGUSR1 ack recieved";
+    appsAPI->disconnectSignals(this, 1);
+    m_backgrounded = false;
+    finishTransition();
+}
+void Application::sigUsr2(int pid){
+    if(m_transition != WaitingForBackground || !isOwnProcess(pid)){
+        return;
+    }
+    qDebug() << "SIGUSR2 ack recieved";
+    appsAPI->disconnectSignals(this, 2);
+    m_backgrounded = true;
+    finishTransition();
+}
+void Application::updateStoppedState(){
+    auto pid = m_process->processId();
+    if(!pid){
+        return;
+    }
+    // Only collect stop and continue notifications, QProcess reaps the exit
+    forever{
+        siginfo_t info;
+        memset(&info, 0, sizeof(info));
+        if(waitid(P_PID, pid, &info, WSTOPPED | WCONTINUED | WNOHANG) || !info.si_pid){
+            break;
+        }
+        m_stopped = info.si_code == CLD_STOPPED || info.si_code == CLD_TRAPPED;
+    }
+    if(
+        (m_transition == WaitingForStop && m_stopped)
+        || (m_transition == WaitingForContinue && !m_stopped)
+    ){
+        finishTransition();
         return;
     }
-    siginfo_t info;
-    waitid(P_PID, m_process->processId(), &info, WSTOPPED);
+    updateState();
 }
-void Application::waitForResume(){
-    if(stateNoSecurityCheck() != Paused){
+void Application::updateState(){
+    auto state = stateNoSecurityCheck();
+    if(state == m_state){
         return;
     }
-    siginfo_t info;
-    waitid(P_PID, m_process->processId(), &info, WCONTINUED);
+    m_state = state;
+    if(m_cgroup != nullptr){
+        m_cgroup->setWeight(state == InForeground ? CGROUP_FOREGROUND_WEIGHT : CGROUP_BACKGROUND_WEIGHT);
+    }
+    appsAPI->updateApplicationState(this, state);
 }
 void Application::resume(){
     if(!hasPermission("apps")){
@@ -132,8 +289,12 @@ void Application::resume(){
     resumeNoSecurityCheck();
 }
 void Application::resumeNoSecurityCheck(){
+    if(inTransition()){
+        afterTransition([this]{ resumeNoSecurityCheck(); });
+        return;
+    }
     if(
-        !m_process->processId()
+        !processId()
         || stateNoSecurityCheck() == InForeground
         || (type() == AppsAPI::Background && stateNoSecurityCheck() == InBackground)
     ){
@@ -142,19 +303,32 @@ void Application::resumeNoSecurityCheck(){
     }
     appsAPI->recordPreviousApplication();
     qDebug() << "Resuming " << path();
+    QElapsedTimer elapsed;
+    elapsed.start();
     appsAPI->pauseAll();
-    if(!flags().contains("nosavescreen") && (type() != AppsAPI::Backgroundable || stateNoSecurityCheck() == Paused)){
-        recallScreen();
-    }
-    uninterruptApplication();
-    waitForResume();
-    emit resumed();
-    emit appsAPI->applicationResumed(qPath());
-    qDebug() << "Resumed " << path();
+    appsAPI->afterTransitions([this, elapsed]{
+        if(!processId() || inTransition() || stateNoSecurityCheck() == InForeground){
+            return;
+        }
+        if(!flags().contains("nosavescreen") && (type() != AppsAPI::Backgroundable || stateNoSecurityCheck() == Paused)){
+            recallScreen();
+        }
+        uninterruptApplication();
+        afterTransition([this, elapsed]{
+            metricsAPI->record(name(), "resume", elapsed);
+            emit resumed();
+            emit appsAPI->applicationResumed(qPath());
+            qDebug() << "Resumed " << path();
+        });
+    });
 }
 void Application::uninterruptApplication(){
+    if(inTransition()){
+        afterTransition([this]{ uninterruptApplication(); });
+        return;
+    }
     if(
-        !m_process->processId()
+        !processId()
         || stateNoSecurityCheck() == InForeground
         || (type() == AppsAPI::Background && stateNoSecurityCheck() == InBackground)
     ){
@@ -167,27 +341,64 @@ void Application::uninterruptApplication(){
         case AppsAPI::Background:
         case AppsAPI::Backgroundable:
             if(stateNoSecurityCheck() == Paused){
-                touchHandler->clear_buffer();
-                kill(-m_process->processId(), SIGCONT);
+                clearInputBuffer();
+                continueProcesses();
             }
             qDebug() << "Waiting for SIGUSR1 ack";
             appsAPI->connectSignals(this, 1);
             kill(-m_process->processId(), SIGUSR1);
-            delayUpTo(1000);
-            appsAPI->disconnectSignals(this, 1);
-            if(timer.isValid()){
-                // No need to fall through, we've just assumed it continued
-                qDebug() << "Warning: application took too long to forground" << name();
-            }else{
-                qDebug() << "SIGUSR1 ack recieved";
-            }
-            m_backgrounded = false;
+            beginTransition(WaitingForForeground);
             break;
         case AppsAPI::Foreground:
         default:
-            touchHandler->clear_buffer();
-            kill(-m_process->processId(), SIGCONT);
+            clearInputBuffer();
+            continueProcesses();
+            beginTransition(WaitingForContinue);
+    }
+}
+void Application::clearInputBuffer(){
+    QElapsedTimer elapsed;
+    elapsed.start();
+    touchHandler->clear_buffer();
+    metricsAPI->record(name(), "clearInput", elapsed);
+}
+void Application::stopProcesses(){
+    if(m_cgroup != nullptr && m_cgroup->freeze(true)){
+        return;
+    }
+    kill(-m_process->processId(), SIGSTOP);
+}
+void Application::continueProcesses(){
+    if(m_cgroup != nullptr && m_cgroup->freeze(false)){
+        return;
+    }
+    kill(-m_process->processId(), SIGCONT);
+}
+void Application::setupCgroup(){
+    if(!Cgroup::available()){
+        return;
+    }
+    if(m_cgroup == nullptr){
+        m_cgroup = new Cgroup(name());
+        m_cgroupEvents.addPath(m_cgroup->eventsPath());
+    }
+    m_cgroup->setMemoryHigh(appsAPI->memoryHigh(type()));
+    m_process->setCgroup(m_cgroup);
+}
+void Application::cgroupEventsChanged(){
+    auto frozen = m_cgroup->isFrozen();
+    if(frozen == m_frozen){
+        return;
+    }
+    m_frozen = frozen;
+    if(
+        (m_transition == WaitingForStop && m_frozen)
+        || (m_transition == WaitingForContinue && !m_frozen)
+    ){
+        finishTransition();
+        return;
     }
+    updateState();
 }
 void Application::stop(){
     if(!hasPermission("apps")){
@@ -196,6 +407,11 @@ void Application::stop(){
     stopNoSecurityCheck();
 }
 void Application::stopNoSecurityCheck(){
+    if(m_primed){
+        // The zygote exits once stdin is closed
+        m_process->closeWriteChannel();
+        return;
+    }
     auto state = this->stateNoSecurityCheck();
     if(state == Inactive){
         return;
@@ -206,7 +422,7 @@ void Application::stopNoSecurityCheck(){
     }
     Application* pausedApplication = nullptr;
     if(state == Paused){
-        touchHandler->clear_buffer();
+        clearInputBuffer();
         auto currentApplication = appsAPI->currentApplicationNoSecurityCheck();
         if(currentApplication.path() != path()){
             pausedApplication = appsAPI->getApplication(currentApplication);
@@ -219,7 +435,7 @@ void Application::stopNoSecurityCheck(){
                 }
             }
         }
-        kill(-m_process->processId(), SIGCONT);
+        continueProcesses();
     }
     kill(-m_process->processId(), SIGTERM);
     // Try to wait for the application to stop normally before killing it
@@ -228,12 +444,18 @@ void Application::stopNoSecurityCheck(){
         m_process->waitForFinished(100);
         if(++tries == 5){
             kill(-m_process->processId(), SIGKILL);
+            if(m_cgroup != nullptr){
+                // Also catch anything that left the process group
+                if(!m_cgroup->kill()){
+                    qDebug() << "Unable to kill everything started by" << name();
+                }
+            }
             break;
         }
     }
 }
 void Application::signal(int signal){
-    if(m_process->processId()){
+    if(processId()){
         kill(-m_process->processId(), signal);
     }
 }
@@ -249,16 +471,15 @@ void Application::unregisterNoSecurityCheck(){
 }
 
 int Application::stateNoSecurityCheck(){
+    if(m_primed){
+        return Inactive;
+    }
     switch(m_process->state()){
         case QProcess::Starting:
         case QProcess::Running:{
-            QFile stat("/proc/" + QString::number(m_process->processId()) + "/stat");
-            if(stat.open(QIODevice::ReadOnly)){
-                auto status = stat.readLine().split(' ');
-                stat.close();
-                if(status.length() > 2 && status[2] == "T"){
-                    return Paused;
-                }
+            // m_stopped is kept up to date from SIGCHLD, no need to ask /proc
+            if(m_stopped || m_frozen){
+                return Paused;
             }
             if(type() == AppsAPI::Background || (type() == AppsAPI::Backgroundable && m_backgrounded)){
                 return InBackground;
@@ -271,32 +492,130 @@ int Application::stateNoSecurityCheck(){
     }
 }
 void Application::setConfig(const QVariantMap& config){
+    if(config == m_config){
+        return;
+    }
     auto oldBin = bin();
     m_config = config;
+    m_permissions = permissions().toSet();
     if(type() == AppsAPI::Foreground){
         setAutoStart(false);
     }
-    if(oldBin == bin()){
+    if(oldBin != bin() && !QFile::exists(bin())){
+        setValue("bin", oldBin);
+    }
+    if(oldBin == bin() && zygote()){
         return;
     }
-    if(!QFile::exists(bin())){
-        setValue("bin", oldBin);
+    // The new binary may be loadable, and a primed zygote holds the old one
+    m_zygoteUnsupported = false;
+    if(m_primed){
+        stopNoSecurityCheck();
+    }
+}
+void Application::setReady(){
+    if(m_ready || !processId()){
+        return;
     }
+    qDebug() << name() << "is ready after" << m_launchTimer.elapsed() << "ms" << (m_zygoteLaunch ? "from zygote" : "");
+    // Kept apart so the two ways of launching can be compared
+    metricsAPI->record(name(), m_zygoteLaunch ? "zygoteReady" : "ready", m_launchTimer);
+    m_ready = true;
+    if(m_backgroundWhenReady){
+        m_backgroundWhenReady = false;
+        interruptApplication();
+    }
+    emit ready();
 }
 void Application::started(){
+    // Make sure stop and continue events are reported now that QProcess has
+    // installed its own SIGCHLD handler
+    SignalHandler::setup_sigchld_handler();
+    if(m_primed){
+        // Waiting for a launch, nothing is running yet
+        return;
+    }
+    qDebug() << "Launched" << name() << "in" << m_launchTimer.elapsed() << "ms" << (m_zygoteLaunch ? "from zygote" : "");
+    metricsAPI->record(name(), m_zygoteLaunch ? "zygoteStart" : "start", m_launchTimer);
+    // Autostarted applications weren't asked for, so they don't count
+    metricsAPI->record(name(), m_zygoteLaunch ? "zygoteLaunch" : "launch", m_launchRequestTimer);
+    m_launchRequestTimer.invalidate();
+    if(!notify()){
+        setReady();
+    }else{
+        auto pid = m_process->processId();
+        QTimer::singleShot(NOTIFY_TIMEOUT, this, [this, pid]{
+            if(!m_ready && m_process->processId() == pid){
+                qDebug() << "Warning:" << name() << "did not report that it was ready";
+                setReady();
+            }
+        });
+    }
+    m_stopped = false;
+    m_processGroup = processId();
+    appsAPI->registerProcessGroup(m_processGroup, this);
+    updateState();
     emit launched();
     emit appsAPI->applicationLaunched(qPath());
+    if(m_pauseWhenStarted){
+        m_pauseWhenStarted = false;
+        interruptApplication();
+    }
 }
 void Application::finished(int exitCode){
+    if(m_primed){
+        m_primed = false;
+        if(exitCode == ZYGOTE_UNSUPPORTED){
+            qDebug() << name() << "can't be run from a zygote, it will be launched normally";
+            m_zygoteUnsupported = true;
+        }else{
+            qDebug() << "Zygote for" << name() << "exited with" << exitCode;
+        }
+        return;
+    }
     qDebug() << "Application" << name() << "exit code" << exitCode;
+    m_ready = false;
+    m_backgroundWhenReady = false;
+    m_pauseWhenStarted = false;
+    m_stopped = false;
+    m_frozen = false;
+    if(m_cgroup != nullptr){
+        m_cgroup->freeze(false);
+        if(m_cgroup->isPopulated()){
+            qDebug() << "Cleaning up processes left behind by" << name();
+            if(!m_cgroup->kill()){
+                qDebug() << "Unable to clean up processes left behind by" << name();
+            }
+        }
+    }
+    m_backgrounded = false;
+    appsAPI->unregisterProcessGroup(m_processGroup, this);
+    m_processGroup = 0;
+    if(inTransition()){
+        qDebug() << "Application" << name() << "exited while pausing or resuming";
+        appsAPI->disconnectSignals(this, 1);
+        appsAPI->disconnectSignals(this, 2);
+        finishTransition();
+    }
+    updateState();
     emit exited(exitCode);
     appsAPI->resumeIfNone();
     emit appsAPI->applicationExited(qPath(), exitCode);
-    umountAll();
+    if(!chroot()){
+        umountAll();
+    }
+    // Get the next launch ready while the user is busy elsewhere
+    QTimer::singleShot(0, this, &Application::prime);
 }
 void Application::errorOccurred(QProcess::ProcessError error){
     switch(error){
         case QProcess::FailedToStart:
+            if(m_primed){
+                qDebug() << "Zygote for" << name() << "failed to start.";
+                m_primed = false;
+                m_zygoteUnsupported = true;
+                return;
+            }
             qDebug() << "Application" << name() << "failed to start.";
             emit exited(-1);
             emit appsAPI->applicationExited(qPath(), -1);
@@ -326,6 +645,8 @@ void Application::showSplashScreen(){
         EPFrameBuffer::waitForLastUpdate();
     }
     qDebug() << "Displaying splashscreen for" << name();
+    QElapsedTimer elapsed;
+    elapsed.start();
     QPainter painter(frameBuffer);
     auto fm = painter.fontMetrics();
     auto size = frameBuffer->size();
@@ -364,8 +685,11 @@ void Application::showSplashScreen(){
     );
     EPFrameBuffer::sendUpdate(textRect, EPFrameBuffer::Grayscale, EPFrameBuffer::PartialUpdate, true);
     painter.end();
+    metricsAPI->record(name(), "splash", elapsed);
     qDebug() << "Waitng for screen to finish...";
+    elapsed.start();
     EPFrameBuffer::waitForLastUpdate();
+    metricsAPI->record(name(), "splashUpdate", elapsed);
     qDebug() << "Finished paining splash screen for" << name();
 }
 void Application::powerStateDataRecieved(FifoHandler* handler, const QString& data){
@@ -11,6 +11,10 @@
 #include <QTime>
 #include <QDir>
 #include <QCoreApplication>
+#include <QSet>
+#include <QTimer>
+#include <QFileSystemWatcher>
+#include <QThread>
 
 #include <zlib.h>
 #include <systemd/sd-journal.h>
@@ -31,20 +35,29 @@
 #include <stdexcept>
 #include <sys/types.h>
 #include <algorithm>
+#include <functional>
 
 #include "dbussettings.h"
 #include "mxcfb.h"
 #include "screenapi.h"
+#include "snapshotstore.h"
+#include "notifysocket.h"
+#include "cgroup.h"
+#include "metricsapi.h"
 #include "fifohandler.h"
 #include "buttonhandler.h"
+#include "zygote.h"
 
+#define NOTIFY_TIMEOUT 10000
+#define MEMORY_POLICY_NEVER_KILL "never-kill"
+#define MEMORY_POLICY_KILL_WHEN_PAUSED "kill-when-paused"
 #define DEFAULT_PATH "/opt/bin:/opt/sbin:/opt/usr/bin:/usr/local/bin:/usr/bin:/bin:/usr/local/sbin:/usr/sbin:/sbin"
 
 class SandBoxProcess : public QProcess{
     Q_OBJECT
 public:
     SandBoxProcess(QObject* parent = nullptr)
-    : QProcess(parent), m_gid(0), m_uid(0), m_chroot(""), m_mask(0) {}
+    : QProcess(parent), m_gid(0), m_uid(0), m_chroot(""), m_mask(0), m_cgroup(nullptr), m_stdout(-1), m_stderr(-1) {}
 
     bool setUser(const QString& name){
         try{
@@ -79,8 +92,37 @@ public:
     void setMask(mode_t mask){
         m_mask = mask;
     }
+    void setCgroup(const Cgroup* cgroup){
+        m_cgroup = cgroup;
+    }
+    // File descriptors to hand to the child as stdout and stderr instead of
+    // the usual pipes, -1 to keep the pipe
+    void setOutputDescriptors(int stdoutFd, int stderrFd){
+        m_stdout = stdoutFd;
+        m_stderr = stderrFd;
+        if(m_stdout == -1){
+            setStandardOutputFile(QString());
+        }else{
+            setStandardOutputFile(QProcess::nullDevice());
+        }
+        if(m_stderr == -1){
+            setStandardErrorFile(QString());
+        }else{
+            setStandardErrorFile(QProcess::nullDevice());
+        }
+    }
 protected:
     void setupChildProcess() override {
+        if(m_cgroup != nullptr){
+            // Join while we still have the permissions to
+            m_cgroup->join();
+        }
+        if(m_stdout != -1){
+            dup2(m_stdout, STDOUT_FILENO);
+        }
+        if(m_stderr != -1){
+            dup2(m_stderr, STDERR_FILENO);
+        }
         // Drop all privileges in the child process
         setgroups(0, 0);
         if(!m_chroot.isEmpty()){
@@ -99,6 +141,9 @@ private:
     uid_t m_uid;
     QString m_chroot;
     mode_t m_mask;
+    const Cgroup* m_cgroup;
+    int m_stdout;
+    int m_stderr;
 
     uid_t getUID(const QString& name){
         auto user = getpwnam(name.toStdString().c_str());
@@ -144,7 +189,7 @@ class Application : public QObject{
     Q_PROPERTY(QStringList directories READ directories WRITE setDirectories NOTIFY directoriesChanged)
 public:
     Application(QDBusObjectPath path, QObject* parent) : Application(path.path(), parent) {}
-    Application(QString path, QObject* parent) : QObject(parent), m_path(path), m_backgrounded(false), fifos() {
+    Application(QString path, QObject* parent) : QObject(parent), m_path(path), m_backgrounded(false), m_stopped(false), m_state(Inactive), m_processGroup(0), m_permissions(), m_ready(false), m_backgroundWhenReady(false), m_pauseWhenStarted(false), m_primed(false), m_zygoteLaunch(false), m_zygoteUnsupported(false), m_transition(NoTransition), m_transitionTimer(this), m_transitionCallbacks(), fifos(), m_cgroup(nullptr), m_frozen(false), m_cgroupEvents(this), m_mounts(), m_sandboxed(false), m_sandboxDirectories(), m_stdout(-1), m_stderr(-1) {
         m_process = new SandBoxProcess(this);
         connect(m_process, &SandBoxProcess::started, this, &Application::started);
         connect(m_process, QOverload<int>::of(&SandBoxProcess::finished), this, &Application::finished);
@@ -152,13 +197,20 @@ public:
         connect(m_process, &SandBoxProcess::readyReadStandardOutput, this, &Application::readyReadStandardOutput);
         connect(m_process, &SandBoxProcess::stateChanged, this, &Application::stateChanged);
         connect(m_process, &SandBoxProcess::errorOccurred, this, &Application::errorOccurred);
+        m_transitionTimer.setSingleShot(true);
+        m_transitionTimer.setInterval(1000);
+        connect(&m_transitionTimer, &QTimer::timeout, this, &Application::transitionTimeout);
+        connect(&m_cgroupEvents, &QFileSystemWatcher::fileChanged, this, &Application::cgroupEventsChanged);
     }
     ~Application() {
         unregisterPath();
         if(screenCapture != nullptr){
-            delete screenCapture;
+            snapshotStore->release(screenCapture);
         }
         umountAll();
+        if(m_cgroup != nullptr){
+            delete m_cgroup;
+        }
     }
 
     QString path() { return m_path; }
@@ -181,6 +233,8 @@ public:
     }
     enum ApplicationState { Inactive, InForeground, InBackground, Paused };
     Q_ENUM(ApplicationState)
+    // What a pause or resume is waiting on before it can continue
+    enum Transition { NoTransition, WaitingForBackground, WaitingForStop, WaitingForForeground, WaitingForContinue };
 
     Q_INVOKABLE void launch();
     Q_INVOKABLE void pause(bool startIfNone = true);
@@ -189,20 +243,24 @@ public:
     Q_INVOKABLE void unregister();
 
     void launchNoSecurityCheck();
+    void autoStartNoSecurityCheck();
     void resumeNoSecurityCheck();
     void stopNoSecurityCheck();
     void pauseNoSecurityCheck(bool startIfNone = true);
     void unregisterNoSecurityCheck();
     QString name() { return value("name").toString(); }
-    int processId() { return m_process->processId(); }
+    // A primed zygote isn't running the application yet
+    int processId() { return m_primed ? 0 : m_process->processId(); }
     QStringList permissions() { return value("permissions", QStringList()).toStringList(); }
     void setPermissions(QStringList permissions){
         if(!hasPermission("permissions")){
             return;
         }
         setValue("permissions", permissions);
+        m_permissions = permissions.toSet();
         emit permissionsChanged(permissions);
     }
+    bool hasPermissionNoSecurityCheck(const QString& permission){ return m_permissions.contains(permission); }
     QString displayName() { return value("displayName", name()).toString(); }
     void setDisplayName(QString displayName){
         if(!hasPermission("permissions")){
@@ -306,6 +364,21 @@ public:
         emit workingDirectoryChanged(workingDirectory);
     }
     bool chroot(){ return flags().contains("chroot"); }
+    // Chroot applications need their mounts in place before they start
+    bool zygote(){ return flags().contains("zygote") && !chroot(); }
+    bool notify(){ return flags().contains("notify"); }
+    // Pass output through tarnish instead of straight to the journal
+    bool teeLog(){ return flags().contains("teelog"); }
+    // What the memory manager is allowed to do with this application. Lower
+    // priorities are killed first.
+    QString memoryPolicy(){ return value("memoryPolicy", MEMORY_POLICY_KILL_WHEN_PAUSED).toString(); }
+    int memoryPriority(){ return value("memoryPriority", 0).toInt(); }
+    QStringList dependencies(){ return value("requires", QStringList()).toStringList(); }
+    bool isReady(){ return m_ready; }
+    // Autostarted and not out of the way yet, so it may still draw
+    bool isStarting(){ return processId() && (m_backgroundWhenReady || m_pauseWhenStarted || inTransition()); }
+    void setReady();
+    void prime();
     QString user(){ return value("user", getuid()).toString(); }
     QString group(){ return value("group", getgid()).toString(); }
     QStringList directories() { return value("directories", QStringList()).toStringList(); }
@@ -324,29 +397,48 @@ public:
         }
         qDebug() << "Saving screen...";
         int frameBufferHandle = open("/dev/fb0", O_RDWR);
-        char* frameBuffer = (char*)mmap(0, DISPLAYSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, frameBufferHandle, 0);
+        auto frameBuffer = (uint16_t*)mmap(0, DISPLAYSIZE, PROT_READ, MAP_SHARED, frameBufferHandle, 0);
+        if(frameBuffer == MAP_FAILED){
+            qDebug() << "Unable to map framebuffer" << ::strerror(errno);
+            close(frameBufferHandle);
+            return;
+        }
         qDebug() << "Compressing data...";
-        auto compressedData = qCompress(QByteArray(frameBuffer, DISPLAYSIZE));
+        QElapsedTimer elapsed;
+        elapsed.start();
+        screenCapture = snapshotStore->save(frameBuffer, DISPLAYWIDTH, DISPLAYHEIGHT);
+        munmap(frameBuffer, DISPLAYSIZE);
         close(frameBufferHandle);
-        screenCapture = new QByteArray(compressedData);
-        qDebug() << "Screen saved.";
+        metricsAPI->record(name(), "saveScreen", elapsed);
+        qDebug() << "Screen saved in" << elapsed.elapsed() << "ms";
+        qDebug() << "Snapshot store holds" << snapshotStore->tileCount() << "tiles in" << snapshotStore->size() << "bytes";
     }
     void recallScreen(){
         if(screenCapture == nullptr){
             return;
         }
-        qDebug() << "Uncompressing screen...";
-        auto uncompressedData = qUncompress(*screenCapture);
-        if(!uncompressedData.size()){
+        qDebug() << "Recalling screen...";
+        int frameBufferHandle = open("/dev/fb0", O_RDWR);
+        auto frameBuffer = (uint16_t*)mmap(0, DISPLAYSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, frameBufferHandle, 0);
+        if(frameBuffer == MAP_FAILED){
+            qDebug() << "Unable to map framebuffer" << ::strerror(errno);
+            close(frameBufferHandle);
+            return;
+        }
+        QElapsedTimer elapsed;
+        elapsed.start();
+        // Tiles are decoded in parallel and written straight into the framebuffer
+        if(!snapshotStore->recall(screenCapture, frameBuffer)){
             qDebug() << "Screen capture was corrupt";
-            qDebug() << screenCapture->size();
-            delete screenCapture;
+            munmap(frameBuffer, DISPLAYSIZE);
+            close(frameBufferHandle);
+            snapshotStore->release(screenCapture);
+            screenCapture = nullptr;
             return;
         }
-        qDebug() << "Recalling screen...";
-        int frameBufferHandle = open("/dev/fb0", O_RDWR);
-        auto frameBuffer = (char*)mmap(0, DISPLAYSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, frameBufferHandle, 0);
-        memcpy(frameBuffer, uncompressedData, DISPLAYSIZE);
+        munmap(frameBuffer, DISPLAYSIZE);
+        qDebug() << "Screen decoded in" << elapsed.elapsed() << "ms";
+        metricsAPI->record(name(), "recallScreen", elapsed);
 
         mxcfb_update_data update_data;
         mxcfb_rect update_rect;
@@ -354,17 +446,36 @@ public:
         update_rect.left = 0;
         update_rect.width = DISPLAYWIDTH;
         update_rect.height = DISPLAYHEIGHT;
-        update_data.update_marker = 0;
+        static quint32 marker = 0;
+        // Zero means no marker, so the counter skips it when it wraps
+        if(!++marker){
+            marker = 1;
+        }
+        update_data.update_marker = marker;
         update_data.update_region = update_rect;
         update_data.waveform_mode = WAVEFORM_MODE_AUTO;
         update_data.update_mode = UPDATE_MODE_FULL;
         update_data.dither_mode = EPDC_FLAG_USE_DITHERING_MAX;
         update_data.temp = TEMP_USE_REMARKABLE_DRAW;
         update_data.flags = 0;
-        ioctl(frameBufferHandle, MXCFB_SEND_UPDATE, &update_data);
-
-        close(frameBufferHandle);
-        delete screenCapture;
+        elapsed.start();
+        if(ioctl(frameBufferHandle, MXCFB_SEND_UPDATE, &update_data) == -1){
+            close(frameBufferHandle);
+        }else{
+            // Time the e-ink update without holding up the resume
+            auto thread = QThread::create([frameBufferHandle, elapsed, application = name(), updateMarker = update_data.update_marker]{
+                mxcfb_update_marker_data marker_data;
+                marker_data.update_marker = updateMarker;
+                marker_data.collision_test = 0;
+                if(ioctl(frameBufferHandle, MXCFB_WAIT_FOR_UPDATE_COMPLETE, &marker_data) != -1){
+                    metricsAPI->record(application, "recallUpdate", elapsed);
+                }
+                close(frameBufferHandle);
+            });
+            connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+            thread->start();
+        }
+        snapshotStore->release(screenCapture);
         screenCapture = nullptr;
         qDebug() << "Screen recalled.";
     }
@@ -378,8 +489,9 @@ public:
     void setValue(QString name, QVariant value){ m_config[name] = value; }
     void interruptApplication();
     void uninterruptApplication();
-    void waitForPause();
-    void waitForResume();
+    void updateStoppedState();
+    bool inTransition(){ return m_transition != NoTransition; }
+    void afterTransition(std::function<void()> callback);
 signals:
     void launched();
     void paused();
@@ -397,14 +509,12 @@ signals:
     void environmentChanged(QVariantMap);
     void workingDirectoryChanged(QString);
     void directoriesChanged(QStringList);
+    void transitionFinished();
+    void ready();
 
 public slots:
-    void sigUsr1(){
-        timer.invalidate();
-    }
-    void sigUsr2(){
-        timer.invalidate();
-    }
+    void sigUsr1(int pid);
+    void sigUsr2(int pid);
 
 private slots:
     void started();
@@ -428,6 +538,7 @@ private slots:
         }
     }
     void stateChanged(QProcess::ProcessState state){
+        updateState();
         switch(state){
             case QProcess::Starting:
                 qDebug() << "Application" << name() << "is starting.";
@@ -443,25 +554,81 @@ private slots:
         }
     }
     void errorOccurred(QProcess::ProcessError error);
+    void transitionTimeout();
+    void cgroupEventsChanged();
     void powerStateDataRecieved(FifoHandler* handler, const QString& data);
 private:
     QVariantMap m_config;
     QString m_path;
     SandBoxProcess* m_process;
     bool m_backgrounded;
-    QByteArray* screenCapture = nullptr;
-    size_t screenCaptureSize;
-    QElapsedTimer timer;
+    bool m_stopped;
+    int m_state;
+    qint64 m_processGroup;
+    QSet<QString> m_permissions;
+    ScreenSnapshot* screenCapture = nullptr;
+    bool m_ready;
+    bool m_backgroundWhenReady;
+    bool m_pauseWhenStarted;
+    // Started as a zygote and waiting to be launched
+    bool m_primed;
+    // The running process was launched from a zygote
+    bool m_zygoteLaunch;
+    bool m_zygoteUnsupported;
+    QElapsedTimer m_launchTimer;
+    QElapsedTimer m_launchRequestTimer;
+    int m_transition;
+    QTimer m_transitionTimer;
+    QElapsedTimer m_transitionElapsed;
+    QList<std::function<void()>> m_transitionCallbacks;
     QMap<QString, FifoHandler*> fifos;
+    Cgroup* m_cgroup;
+    bool m_frozen;
+    QFileSystemWatcher m_cgroupEvents;
+    QSet<QString> m_mounts;
+    bool m_sandboxed;
+    QStringList m_sandboxDirectories;
+    int m_stdout;
+    int m_stderr;
 
     bool hasPermission(QString permission, const char* sender = __builtin_FUNCTION());
+    void updateState();
     void showSplashScreen();
-    void delayUpTo(int milliseconds){
-        timer.invalidate();
-        timer.start();
-        while(timer.isValid() && !timer.hasExpired(milliseconds)){
-            QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+    void startProcess();
+    void spawn(const QString& program, const QStringList& arguments);
+    void clearInputBuffer();
+    void stopProcesses();
+    void continueProcesses();
+    void setupCgroup();
+    void beginTransition(int transition);
+    void finishTransition();
+    bool isOwnProcess(int pid){
+        auto processId = m_process->processId();
+        return processId && (pid == processId || getpgid(pid) == processId);
+    }
+    void openLogStreams(){
+        closeLogStreams();
+        if(!teeLog()){
+            auto identifier = name().toUtf8();
+            m_stdout = sd_journal_stream_fd(identifier.constData(), LOG_INFO, true);
+            m_stderr = sd_journal_stream_fd(identifier.constData(), LOG_ERR, true);
+            if(m_stdout < 0 || m_stderr < 0){
+                qDebug() << "Unable to open journal streams for" << name() << ::strerror(-std::min(m_stdout, m_stderr));
+                closeLogStreams();
+            }
+        }
+        m_process->setOutputDescriptors(m_stdout, m_stderr);
+    }
+    // The child has its own copies once it's been forked
+    void closeLogStreams(){
+        if(m_stdout >= 0){
+            close(m_stdout);
+        }
+        if(m_stderr >= 0){
+            close(m_stderr);
         }
+        m_stdout = -1;
+        m_stderr = -1;
     }
     void updateEnvironment(){
         auto env = QProcessEnvironment::systemEnvironment();
@@ -473,9 +640,27 @@ private:
             }
         }
         env.insert("PATH", envPath);
+        if(notify()){
+            env.insert("NOTIFY_SOCKET", NOTIFY_SOCKET_PATH);
+        }
         for(auto key : environment().keys()){
             env.insert(key, environment().value(key, "").toString());
         }
+        // The real touch and buttons devices stay grabbed by tarnish, without
+        // a device Qt's evdev plugins would find those and never get any events
+        const QList<QPair<QString, QString>> devices{
+            {"OXIDE_TOUCH_DEVICE", "QT_QPA_EVDEV_TOUCHSCREEN_PARAMETERS"},
+            {"OXIDE_WACOM_DEVICE", "QT_QPA_EVDEV_TABLET_PARAMETERS"},
+            {"OXIDE_BUTTONS_DEVICE", "QT_QPA_EVDEV_KEYBOARD_PARAMETERS"},
+        };
+        for(auto& device : devices){
+            auto path = env.value(device.first);
+            auto parameters = env.value(device.second);
+            if(path.isEmpty() || parameters.contains("/dev/")){
+                continue;
+            }
+            env.insert(device.second, parameters.isEmpty() ? path : path + ":" + parameters);
+        }
         m_process->setEnvironment(env.toStringList());
     }
     void mkdirs(const QString& path, mode_t mode = 0700){
@@ -505,6 +690,7 @@ private:
             qWarning() << "Failed to create bindmount: " << ::strerror(errno);
             return;
         }
+        m_mounts.insert(target);
         if(!readOnly){
             return;
         }
@@ -519,7 +705,9 @@ private:
         qDebug() << "sysfs" << path;
         if(mount("none", path.toStdString().c_str(), "sysfs", 0, "")){
             qWarning() << "Failed to mount sysfs: " << ::strerror(errno);
+            return;
         }
+        m_mounts.insert(path);
     }
     void ramdisk(const QString& path){
         mkdirs(path, 744);
@@ -527,18 +715,20 @@ private:
         qDebug() << "ramdisk" << path;
         if(mount("tmpfs", path.toStdString().c_str(), "tmpfs", 0, "size=249m,mode=755")){
             qWarning() << "Failed to create ramdisk: " << ::strerror(errno);
+            return;
         }
+        m_mounts.insert(path);
     }
     void umount(const QString& path){
         if(!isMounted(path)){
             return;
         }
         auto cpath = path.toStdString();
-        ::umount(cpath.c_str());
-        if(isMounted(path)){
-            qDebug() << "umount failed" << path;
+        if(::umount(cpath.c_str())){
+            qDebug() << "umount failed" << path << ::strerror(errno);
             return;
         }
+        m_mounts.remove(path);
         QDir dir(path);
         if(dir.exists()){
             rmdir(cpath.c_str());
@@ -589,9 +779,58 @@ private:
     }
     const QString resourcePath() { return "/tmp/tarnish-chroot/" + name(); }
     const QString chrootPath() { return resourcePath() + "/chroot"; }
+    // Cleared on every launch, nothing an application leaves in them is kept
+    const QStringList volatileDirectories(){ return QStringList() << "/run" << "/var/volatile" << "/tmp"; }
+    // The chroot's mounts are kept between launches and only rebuilt when it's
+    // missing something or the configured directories have changed
+    bool sandboxReady(){
+        if(!m_sandboxed || m_sandboxDirectories != directories()){
+            return false;
+        }
+        for(auto directory : directories()){
+            for(auto volatileDirectory : volatileDirectories()){
+                if(directory.startsWith(volatileDirectory + "/")){
+                    // Can't be cleared without tearing that mount down too
+                    return false;
+                }
+            }
+        }
+        readMounts();
+        auto path = chrootPath();
+        return isMounted(path + "/proc") && isMounted(path + "/sys") && isMounted(path + "/sys/power/state");
+    }
+    // Gives a reused chroot the empty tmpfs folders a new one would have
+    void resetVolatile(){
+        auto path = chrootPath();
+        for(auto directory : volatileDirectories()){
+            auto target = path + directory;
+            if(hasMountsUnder(target)){
+                qDebug() << "Not clearing" << target << "something is mounted in it";
+                continue;
+            }
+            if(directory == "/tmp"){
+                // Not a mount of its own
+                QDir(target).removeRecursively();
+                mkdirs(target, 744);
+                continue;
+            }
+            umount(target);
+            ramdisk(target);
+        }
+    }
+    bool hasMountsUnder(const QString& path){
+        auto prefix = path + "/";
+        for(auto mount : m_mounts){
+            if(mount.startsWith(prefix)){
+                return true;
+            }
+        }
+        return false;
+    }
     void mountAll(){
         auto path = chrootPath();
         qDebug() << "Setting up chroot" << path;
+        readMounts();
         // System tmpfs folders
         bind("/dev", path + "/dev");
         bind("/proc", path + "/proc");
@@ -608,13 +847,7 @@ private:
         bind("/opt/usr/bin", path + "/opt/usr/bin", true);
         bind("/opt/usr/lib", path + "/opt/usr/lib", true);
         // tmpfs folders
-        mkdirs(path + "/tmp", 744);
-        if(!QFile::exists(path + "/run")){
-            ramdisk(path + "/run");
-        }
-        if(!QFile::exists(path + "/var/volatile")){
-            ramdisk(path + "/var/volatile");
-        }
+        resetVolatile();
         // Configured folders
         for(auto directory : directories()){
             bind(directory, path + directory);
@@ -626,9 +859,12 @@ private:
         symlink(path + "/var/run", "../run");
         symlink(path + "/var/lock", "../run/lock");
         symlink(path + "/var/tmp", "volatile/tmp");
+        m_sandboxDirectories = directories();
+        m_sandboxed = true;
     }
     void umountAll(){
         auto path = chrootPath();
+        m_sandboxed = false;
         for(auto name : fifos.keys()){
             auto fifo = fifos.take(name);
             fifo->quit();
@@ -642,6 +878,7 @@ private:
         for(auto file : dir.entryList(QDir::Files)){
             QFile::remove(file);
         }
+        readMounts();
         for(auto mount : getActiveApplicationMounts()){
             umount(mount);
         }
@@ -651,33 +888,49 @@ private:
         }
         dir.removeRecursively();
     }
-    bool isMounted(const QString& path){ return getActiveMounts().contains(path); }
+    bool isMounted(const QString& path){ return m_mounts.contains(path); }
     QStringList getActiveApplicationMounts(){
         auto path = chrootPath() + "/";
-        QStringList activeMounts = getActiveMounts().filter(QRegularExpression("^" + QRegularExpression::escape(path) + ".*"));
+        QStringList activeMounts;
+        for(auto mount : m_mounts){
+            if(mount.startsWith(path)){
+                activeMounts.append(mount);
+            }
+        }
+        // Deepest first so nested mounts are removed before their parents
         activeMounts.sort(Qt::CaseSensitive);
         std::reverse(std::begin(activeMounts), std::end(activeMounts));
         return activeMounts;
     }
-    QStringList getActiveMounts(){
-        QFile mounts("/proc/mounts");
+    // Snapshot the mount table once per operation, the mount helpers keep it
+    // up to date afterwards
+    void readMounts(){
+        m_mounts.clear();
+        QFile mounts("/proc/self/mountinfo");
         if(!mounts.open(QIODevice::ReadOnly)){
-            qDebug() << "Unable to open /proc/mounts";
-            return QStringList();
+            qDebug() << "Unable to open /proc/self/mountinfo";
+            return;
         }
-        QString line;
-        QStringList activeMounts;
-        while(!(line = mounts.readLine()).isEmpty()){
-            auto mount = line.section(' ', 1, 1);
+        for(auto line : mounts.readAll().split('\n')){
+            auto mount = line.split(' ').value(4);
             if(mount.startsWith("/")){
-                activeMounts.append(mount);
+                m_mounts.insert(unescapeMount(mount));
             }
-
         }
         mounts.close();
-        activeMounts.sort(Qt::CaseSensitive);
-        std::reverse(std::begin(activeMounts), std::end(activeMounts));
-        return activeMounts;
+    }
+    static QString unescapeMount(const QByteArray& mount){
+        // Spaces, tabs, newlines and backslashes are written as octal escapes
+        QByteArray result;
+        for(int i = 0; i < mount.size(); i++){
+            if(mount[i] == '\\' && i + 3 < mount.size()){
+                result.append((char)mount.mid(i + 1, 3).toInt(nullptr, 8));
+                i += 3;
+            }else{
+                result.append(mount[i]);
+            }
+        }
+        return QString::fromLocal8Bit(result);
     }
 };
 
@@ -7,6 +7,17 @@ AppsAPI::AppsAPI(QObject* parent)
   m_starting(true),
   m_enabled(false),
   applications(),
+  applicationPaths(),
+  stateIndex(),
+  pendingStarts(),
+  initialApplication(),
+  applicationCache(),
+  applicationWatcher(this),
+  applicationReloadTimer(this),
+  notifySocket(new NotifySocket(this)),
+  memoryManager(new MemoryManager(this)),
+  reclaimingPath(),
+  reclaimingBytes(0),
   previousApplications(),
   settings(this),
   m_startupApplication("/"),
@@ -16,6 +27,38 @@ AppsAPI::AppsAPI(QObject* parent)
   m_sleeping(false) {
     singleton(this);
     SignalHandler::setup_unix_signal_handlers();
+    connect(notifySocket, &NotifySocket::notified, this, [this](int pid, QStringList fields){
+        auto app = getApplicationForProcessGroup(getpgid(pid));
+        if(app == nullptr){
+            qDebug() << "Notification from unknown process" << pid << fields;
+            return;
+        }
+        if(fields.contains("READY=1")){
+            app->setReady();
+        }
+    });
+    connect(memoryManager, &MemoryManager::memoryLow, this, &AppsAPI::reclaimMemory);
+    connect(this, &AppsAPI::applicationExited, this, [this](QDBusObjectPath path){
+        if(path.path() != reclaimingPath){
+            return;
+        }
+        reclaimingPath.clear();
+        emit applicationKilled(path, reclaimingBytes);
+        // Pressure means something has to go, after that only while memory is low
+        if(memoryManager->isLow()){
+            reclaimMemory();
+        }
+    });
+    connect(this, &AppsAPI::applicationUnregistered, this, [this](QDBusObjectPath path){
+        if(path.path() == reclaimingPath){
+            reclaimingPath.clear();
+        }
+    });
+    connect(signalHandler, &SignalHandler::sigChld, this, [this]{
+        for(auto app : runningApplicationList() + stateIndex.value(Application::Paused).values()){
+            app->updateStoppedState();
+        }
+    });
     qDBusRegisterMetaType<QMap<QString,QDBusObjectPath>>();
     qDBusRegisterMetaType<QDBusObjectPath>();
     settings.sync();
@@ -23,7 +66,16 @@ AppsAPI::AppsAPI(QObject* parent)
     if(version < OXIDE_SETTINGS_VERSION){
         migrate(&settings, version);
     }
+    snapshotStore->setBudget(settings.value("snapshotMemoryBudget", DEFAULT_SNAPSHOT_MEMORY_BUDGET).toInt());
+    readApplicationCache();
     readApplications();
+    // Changes usually come in bursts while files are written, handle them once
+    applicationReloadTimer.setSingleShot(true);
+    applicationReloadTimer.setInterval(100);
+    connect(&applicationReloadTimer, &QTimer::timeout, this, &AppsAPI::readSystemApplications);
+    applicationWatcher.addPath(OXIDE_APPLICATIONS_DIRECTORY);
+    connect(&applicationWatcher, &QFileSystemWatcher::directoryChanged, &applicationReloadTimer, QOverload<>::of(&QTimer::start));
+    connect(&applicationWatcher, &QFileSystemWatcher::fileChanged, &applicationReloadTimer, QOverload<>::of(&QTimer::start));
 
     auto path = QDBusObjectPath(settings.value("lockscreenApplication").toString());
     auto app = getApplication(path);
@@ -67,16 +119,6 @@ AppsAPI::AppsAPI(QObject* parent)
 }
 
 void AppsAPI::startup(){
-    for(auto app : applications){
-        if(app->autoStart()){
-            qDebug() << "Auto starting" << app->name();
-            app->launchNoSecurityCheck();
-            if(app->type() == Backgroundable){
-                qDebug() << "  Pausing auto started app" << app->name();
-                app->pauseNoSecurityCheck();
-            }
-        }
-    }
     auto app = getApplication(m_lockscreenApplication);
     if(app == nullptr){
         qDebug() << "Could not find lockscreen application";
@@ -84,11 +126,132 @@ void AppsAPI::startup(){
     }
     if(app == nullptr){
         qDebug() << "could not find startup application";
+        m_starting = false;
+    }else{
+        initialApplication = app->name();
+    }
+    for(auto app : applications){
+        if(app->autoStart()){
+            pendingStarts.append(app->name());
+        }
+    }
+    startPendingApplications();
+    launchInitialApplication();
+}
+// The lockscreen isn't saved when it's paused, so it's only launched once no
+// autostarted application can draw over it. With only background services to
+// start that is straight away.
+void AppsAPI::launchInitialApplication(){
+    if(initialApplication.isEmpty()){
+        return;
+    }
+    for(auto app : applications){
+        if(
+            app->autoStart()
+            && app->type() != Background
+            && (pendingStarts.contains(app->name()) || app->isStarting())
+        ){
+            return;
+        }
+    }
+    auto app = getApplication(initialApplication);
+    initialApplication.clear();
+    if(app == nullptr){
+        qDebug() << "Initial application is gone";
+        m_starting = false;
         return;
     }
     qDebug() << "Starting initial application" << app->name();
     app->launchNoSecurityCheck();
-    m_starting = false;
+    afterTransitions([this]{
+        m_starting = false;
+        // Left until now so that priming doesn't hold up the first screen
+        for(auto app : applications){
+            app->prime();
+        }
+    });
+}
+void AppsAPI::startPendingApplications(){
+    if(pendingStarts.isEmpty()){
+        return;
+    }
+    bool started = false;
+    for(auto name : QStringList(pendingStarts)){
+        auto app = getApplication(name);
+        if(app == nullptr){
+            pendingStarts.removeAll(name);
+            continue;
+        }
+        bool blocked = false;
+        for(auto dependency : app->dependencies()){
+            auto required = getApplication(dependency);
+            if(required == nullptr){
+                qDebug() << name << "requires missing application" << dependency;
+                continue;
+            }
+            if(required->isReady()){
+                continue;
+            }
+            blocked = true;
+            if(!pendingStarts.contains(dependency) && !required->processId()){
+                pendingStarts.append(dependency);
+            }
+        }
+        if(!blocked){
+            pendingStarts.removeAll(name);
+            app->autoStartNoSecurityCheck();
+            started = true;
+        }
+    }
+    if(started || pendingStarts.isEmpty()){
+        return;
+    }
+    for(auto app : applications){
+        if(app->processId() && !app->isReady()){
+            // Still waiting on something that is starting
+            return;
+        }
+    }
+    qDebug() << "Unable to satisfy dependencies, starting anyway:" << pendingStarts;
+    for(auto name : pendingStarts){
+        auto app = getApplication(name);
+        if(app != nullptr){
+            app->autoStartNoSecurityCheck();
+        }
+    }
+    pendingStarts.clear();
 }
 
 bool AppsAPI::locked(){ return notificationAPI->locked(); }
+
+void AppsAPI::reclaimMemory(){
+    if(!reclaimingPath.isEmpty()){
+        // Memory is checked again once it has exited
+        return;
+    }
+    QList<Application*> candidates;
+    for(auto app : stateIndex.value(Application::Paused)){
+        if(app->memoryPolicy() != MEMORY_POLICY_NEVER_KILL){
+            candidates.append(app);
+        }
+    }
+    if(candidates.isEmpty()){
+        qDebug() << "Low on memory, but there are no paused applications to stop";
+        return;
+    }
+    // Lowest priority first, then least recently used
+    std::sort(candidates.begin(), candidates.end(), [this](Application* a, Application* b){
+        if(a->memoryPriority() != b->memoryPriority()){
+            return a->memoryPriority() < b->memoryPriority();
+        }
+        return previousApplications.lastIndexOf(a->name()) < previousApplications.lastIndexOf(b->name());
+    });
+    auto app = candidates.first();
+    reclaimingPath = app->path();
+    reclaimingBytes = MemoryManager::resident(app->processId());
+    qDebug() << "Low on memory, killing" << app->name() << "to reclaim" << reclaimingBytes << "bytes";
+    // SIGKILL is delivered even while stopped, so it never gets a chance
+    // to draw over the current application. The next one is only chosen
+    // once this one's memory has been freed.
+    app->signal(SIGKILL);
+}
@@ -13,15 +13,41 @@
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QMutex>
+#include <QHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QSaveFile>
+#include <QStandardPaths>
 
 #include "apibase.h"
 #include "application.h"
 #include "signalhandler.h"
+#include "memorymanager.h"
 
 #define OXIDE_SETTINGS_VERSION 1
+#define DEFAULT_SNAPSHOT_MEMORY_BUDGET 8 * 1024 * 1024
+
+#define OXIDE_APPLICATIONS_DIRECTORY "/opt/usr/share/applications/"
+#define OXIDE_APPLICATION_CACHE_MAGIC 0x4f584143 // OXAC
+#define OXIDE_APPLICATION_CACHE_VERSION 1
 
 #define appsAPI AppsAPI::singleton()
 
+// Parsed .oxide file, keyed by path in the application cache
+struct ApplicationCacheEntry {
+    qint64 modified;
+    qint64 size;
+    QVariantMap properties;
+};
+inline QDataStream& operator<<(QDataStream& stream, const ApplicationCacheEntry& entry){
+    return stream << entry.modified << entry.size << entry.properties;
+}
+inline QDataStream& operator>>(QDataStream& stream, ApplicationCacheEntry& entry){
+    return stream >> entry.modified >> entry.size >> entry.properties;
+}
+
 class AppsAPI : public APIBase {
     Q_OBJECT
     Q_CLASSINFO("D-Bus Interface", OXIDE_APPS_INTERFACE)
@@ -35,6 +61,8 @@ class AppsAPI : public APIBase {
     Q_PROPERTY(QDBusObjectPath currentApplication READ currentApplication)
     Q_PROPERTY(QVariantMap runningApplications READ runningApplications)
     Q_PROPERTY(QVariantMap pausedApplications READ pausedApplications)
+    Q_PROPERTY(int snapshotMemoryBudget READ snapshotMemoryBudget WRITE setSnapshotMemoryBudget)
+    Q_PROPERTY(QVariantMap snapshotStatistics READ snapshotStatistics)
 public:
     static AppsAPI* singleton(AppsAPI* self = nullptr){
         static AppsAPI* instance;
@@ -56,8 +84,15 @@ public:
             delete app;
         }
         applications.clear();
+        applicationPaths.clear();
+        stateIndex.clear();
+        processGroups.clear();
     }
     void startup();
+    void startPendingApplications();
+    void launchInitialApplication();
+    bool stopping(){ return m_stopping; }
+    void reclaimMemory();
     int state() { return 0; } // Ignore this, it's a kludge to get the xml to generate
 
     enum ApplicationType { Foreground, Background, Backgroundable};
@@ -103,7 +138,10 @@ public:
         auto app = new Application(path, reinterpret_cast<QObject*>(this));
         auto displayName = properties.value("displayName", name).toString();
         app->setConfig(properties);
+        connect(app, &Application::ready, this, &AppsAPI::startPendingApplications);
+        connect(app, &Application::exited, this, &AppsAPI::startPendingApplications);
         applications.insert(name, app);
+        applicationPaths.insert(path.path(), app);
         app->registerPath();
         emit applicationRegistered(path);
         return path;
@@ -210,12 +248,11 @@ public:
         return currentApplicationNoSecurityCheck();
     }
     QDBusObjectPath currentApplicationNoSecurityCheck(){
-        for(auto app : applications){
-            if(app->stateNoSecurityCheck() == Application::InForeground){
-                return app->qPath();
-            }
+        auto foreground = stateIndex.value(Application::InForeground);
+        if(foreground.isEmpty()){
+            return QDBusObjectPath("/");
         }
-        return QDBusObjectPath("/");
+        return foreground.first()->qPath();
     }
 
     QVariantMap runningApplications(){
@@ -226,11 +263,8 @@ public:
     }
     QVariantMap runningApplicationsNoSecurityCheck(){
         QVariantMap result;
-        for(auto app : applications){
-            auto state = app->stateNoSecurityCheck();
-            if(state == Application::InForeground || state == Application::InBackground){
-                result.insert(app->name(), QVariant::fromValue(app->qPath()));
-            }
+        for(auto app : runningApplicationList()){
+            result.insert(app->name(), QVariant::fromValue(app->qPath()));
         }
         return result;
     }
@@ -239,37 +273,110 @@ public:
         if(!hasPermission("apps")){
             return result;
         }
-        for(auto app : applications){
-            auto state = app->stateNoSecurityCheck();
-            if(state == Application::Paused){
-                result.insert(app->name(), QVariant::fromValue(app->qPath()));
-            }
+        for(auto app : stateIndex.value(Application::Paused)){
+            result.insert(app->name(), QVariant::fromValue(app->qPath()));
         }
         return result;
     }
+    QList<Application*> runningApplicationList(){
+        return stateIndex.value(Application::InForeground).values() + stateIndex.value(Application::InBackground).values();
+    }
+    void updateApplicationState(Application* app, int state){
+        auto name = app->name();
+        for(auto& index : stateIndex){
+            index.remove(name);
+        }
+        if(state != Application::Inactive && applications.value(name) == app){
+            stateIndex[state].insert(name, app);
+        }
+    }
+
+    // Optional memory.high limit for each application type, 0 for no limit
+    qulonglong memoryHigh(int type){
+        static const QStringList types { "foreground", "background", "backgroundable" };
+        return settings.value("memoryHigh/" + types.value(type), 0).toULongLong();
+    }
+    Application* getApplicationForProcessGroup(pid_t pgid){ return processGroups.value(pgid, nullptr); }
+    void registerProcessGroup(pid_t pgid, Application* app){ processGroups.insert(pgid, app); }
+    void unregisterProcessGroup(pid_t pgid, Application* app){
+        if(processGroups.value(pgid) == app){
+            processGroups.remove(pgid);
+        }
+        APIBase::forgetProcessGroup(pgid);
+    }
+
+    int snapshotMemoryBudget(){
+        if(!hasPermission("apps")){
+            return 0;
+        }
+        return snapshotStore->budget();
+    }
+    void setSnapshotMemoryBudget(int budget){
+        if(!hasPermission("apps") || budget < 0){
+            return;
+        }
+        snapshotStore->setBudget(budget);
+        settings.setValue("snapshotMemoryBudget", budget);
+    }
+    QVariantMap snapshotStatistics(){
+        if(!hasPermission("apps")){
+            return QVariantMap();
+        }
+        return snapshotStore->statistics();
+    }
 
     void unregisterApplication(Application* app){
         auto name = app->name();
         if(applications.contains(name)){
             applications.remove(name);
+            applicationPaths.remove(app->path());
+            updateApplicationState(app, Application::Inactive);
+            for(auto pgid : processGroups.keys(app)){
+                unregisterProcessGroup(pgid, app);
+            }
             emit applicationUnregistered(app->qPath());
             app->deleteLater();
         }
     }
     void pauseAll(){
-        for(auto app : applications){
+        for(auto app : runningApplicationList()){
             app->pauseNoSecurityCheck(false);
         }
     }
-    void resumeIfNone(){
-        if(m_stopping || m_starting){
-            return;
-        }
+    // Run callback once no application is waiting on a pause or resume
+    void afterTransitions(std::function<void()> callback){
+        transitionCallbacks.append(callback);
+        transitionFinished();
+    }
+    void transitionFinished(){
         for(auto app : applications){
-            if(app->stateNoSecurityCheck() == Application::InForeground){
+            if(app->inTransition()){
                 return;
             }
         }
+        // A callback may start another transition, the rest wait for that one
+        while(!transitionCallbacks.isEmpty()){
+            transitionCallbacks.takeFirst()();
+            for(auto app : applications){
+                if(app->inTransition()){
+                    return;
+                }
+            }
+        }
+        // An autostarted application may have just got out of the way
+        launchInitialApplication();
+    }
+    void resumeIfNone(){
+        if(m_starting){
+            launchInitialApplication();
+            return;
+        }
+        if(m_stopping){
+            return;
+        }
+        if(!stateIndex.value(Application::InForeground).isEmpty()){
+            return;
+        }
         if(previousApplicationNoSecurityCheck()){
             return;
         }
@@ -278,14 +385,7 @@ public:
             app->launchNoSecurityCheck();
         }
     }
-    Application* getApplication(QDBusObjectPath path){
-        for(auto app : applications){
-            if(app->path() == path.path()){
-                return app;
-            }
-        }
-        return nullptr;
-    }
+    Application* getApplication(QDBusObjectPath path){ return applicationPaths.value(path.path(), nullptr); }
     QStringList getPreviousApplications(){ return previousApplications; }
     Q_INVOKABLE QDBusObjectPath getApplicationPath(QString name){
         if(!hasPermission("apps")){
@@ -392,6 +492,7 @@ signals:
     void applicationPaused(QDBusObjectPath);
     void applicationResumed(QDBusObjectPath);    void applicationSignaled(QDBusObjectPath);
     void applicationExited(QDBusObjectPath, int);
+    void applicationKilled(QDBusObjectPath, qulonglong);
 
 public slots:
     QT_DEPRECATED void leftHeld(){ openDefaultApplication(); }
@@ -508,6 +609,21 @@ private:
     bool m_starting;
     bool m_enabled;
     QMap<QString, Application*> applications;
+    QHash<QString, Application*> applicationPaths;
+    QHash<pid_t, Application*> processGroups;
+    QList<std::function<void()>> transitionCallbacks;
+    QMap<int, QMap<QString, Application*>> stateIndex;
+    QStringList pendingStarts;
+    // Launched by launchInitialApplication() once startup allows it
+    QString initialApplication;
+    QMap<QString, ApplicationCacheEntry> applicationCache;
+    QFileSystemWatcher applicationWatcher;
+    QTimer applicationReloadTimer;
+    NotifySocket* notifySocket;
+    MemoryManager* memoryManager;
+    // The application killed to free memory that hasn't exited yet
+    QString reclaimingPath;
+    qulonglong reclaimingBytes;
     QStringList previousApplications;
     QSettings settings;
     QDBusObjectPath m_startupApplication;
@@ -589,6 +705,9 @@ private:
                 {"workingDirectory", settings.value("workingDirectory", "").toString()},
                 {"directories", settings.value("directories", QStringList()).toStringList()},
                 {"permissions", settings.value("permissions", QStringList()).toStringList()},
+                {"requires", settings.value("requires", QStringList()).toStringList()},
+                {"memoryPolicy", settings.value("memoryPolicy", MEMORY_POLICY_KILL_WHEN_PAUSED).toString()},
+                {"memoryPriority", settings.value("memoryPriority", 0).toInt()},
                 {"splash", settings.value("splash", "").toString()},
             };
             if(settings.contains("user")){
@@ -612,24 +731,54 @@ private:
             }
         }
         settings.endArray();
-        // Load system applications from disk
-        QDir dir("/opt/usr/share/applications/");
+        readSystemApplications();
+    }
+    // Load system applications from disk, only parsing files that changed
+    // since they were last cached
+    void readSystemApplications(){
+        QDir dir(OXIDE_APPLICATIONS_DIRECTORY);
         dir.setNameFilters(QStringList() << "*.oxide");
-        QMap<QString, QJsonObject> apps;
+        QMap<QString, QVariantMap> apps;
+        QStringList paths;
+        bool changed = false;
         for(auto entry : dir.entryInfoList()){
-            QFile file(entry.filePath());
-            if(!file.open(QIODevice::ReadOnly)){
+            auto path = entry.filePath();
+            paths.append(path);
+            auto modified = entry.lastModified().toMSecsSinceEpoch();
+            auto size = entry.size();
+            auto cached = applicationCache.constFind(path);
+            QVariantMap properties;
+            if(cached != applicationCache.constEnd() && cached->modified == modified && cached->size == size){
+                properties = cached->properties;
+            }else{
+                properties = parseSystemApplication(entry);
+                applicationCache.insert(path, ApplicationCacheEntry{
+                    .modified = modified,
+                    .size = size,
+                    .properties = properties,
+                });
+                changed = true;
+            }
+            if(properties.isEmpty()){
                 continue;
             }
-            auto data = file.readAll();
-            auto app = QJsonDocument::fromJson(data).object();
-            if(app.isEmpty()){
-                qDebug() << "Invalid file " << entry.filePath();
-                continue;
+            apps.insert(properties["name"].toString(), properties);
+        }
+        for(auto path : applicationCache.keys()){
+            if(!paths.contains(path)){
+                applicationCache.remove(path);
+                changed = true;
+            }
+        }
+        if(changed){
+            writeApplicationCache();
+        }
+        // The directory watch doesn't see files being edited in place
+        auto watched = applicationWatcher.files();
+        for(auto path : paths){
+            if(!watched.contains(path)){
+                applicationWatcher.addPath(path);
             }
-            auto name = entry.completeBaseName();
-            app["name"] = name;
-            apps.insert(name, app);
         }
         // Unregister any system applications that no longer exist on disk.
         for(auto application : applications.values()){
@@ -640,100 +789,15 @@ private:
             }
         }
         // Register/Update any system application.
-        for(auto app : apps){
-            auto name = app["name"].toString();
-            int type = Foreground;
-            QString typeString = app.contains("type") ? app["type"].toString().toLower() : "";
-            if(typeString == "background"){
-                type = Background;
-            }else if(typeString == "backgroundable"){
-                type = Backgroundable;
-            }else if(!typeString.isEmpty() && typeString != "foreground"){
-                qDebug() << "Invalid type string:" << typeString;
-            }
-            auto bin = app["bin"].toString();
+        for(auto properties : apps){
+            auto name = properties["name"].toString();
+            auto bin = properties["bin"].toString();
             if(bin.isEmpty() || !QFile::exists(bin)){
+                // Possibly mid upgrade, anything already running is left alone
                 qDebug() << name << "Can't find application binary:" << bin;
-#ifdef DEBUG
-                qDebug() << app;
-#endif
                 continue;
             }
-            auto flags = QStringList() << "system";
-            if(app.contains("flags")){
-                for(auto flag : app["flags"].toArray()){
-                    auto value = flag.toString();
-                    if(!value.isEmpty() && value != "system"){
-                        flags << value;
-                    }
-                }
-            }
-            QVariantMap properties {
-                {"name", name},
-                {"bin", bin},
-                {"type", type},
-                {"flags", flags},
-            };
-            if(app.contains("displayName")){
-                properties.insert("displayName", app["displayName"].toString());
-            }
-            if(app.contains("description")){
-                properties.insert("description", app["description"].toString());
-            }
-            if(app.contains("icon")){
-                properties.insert("icon", app["icon"].toString());
-            }
-            if(app.contains("user")){
-                properties.insert("user", app["user"].toString());
-            }
-            if(app.contains("group")){
-                properties.insert("group", app["group"].toString());
-            }
-            if(app.contains("workingDirectory")){
-                properties.insert("workingDirectory", app["workingDirectory"].toString());
-            }
-            if(app.contains("directories")){
-                QStringList directories;
-                for(auto directory : app["directories"].toArray()){
-                    directories.append(directory.toString());
-                }
-                properties.insert("directories", directories);
-            }
-            if(app.contains("permissions")){
-                QStringList permissions;
-                for(auto permission : app["permissions"].toArray()){
-                    permissions.append(permission.toString());
-                }
-                properties.insert("permissions", permissions);
-            }
-            if(app.contains("events")){
-                auto events = app["events"].toObject();
-                for(auto event : events.keys()){
-                    if(event == "stop"){
-                        properties.insert("onStop", events[event].toString());
-                    }else if(event == "pause"){
-                        properties.insert("onPause", events[event].toString());
-                    }else if(event == "resume"){
-                        properties.insert("onResume", events[event].toString());
-                    }
-                }
-            }
-            if(app.contains("environment")){
-                QVariantMap envMap;
-                auto environment = app["environment"].toObject();
-                for(auto key : environment.keys()){
-                    envMap.insert(key, environment[key].toString());
-                }
-                properties.insert("environment", envMap);
-            }
-            if(app.contains("splash")){
-                properties.insert("splash", app["splash"].toString());
-            }
             if(applications.contains(name)){
-#ifdef DEBUG
-                qDebug() << "Updating " << name;
-                qDebug() << properties;
-#endif
                 applications[name]->setConfig(properties);
             }else{
                 qDebug() << "New system app" << name;
@@ -744,6 +808,148 @@ private:
             }
         }
     }
+    QVariantMap parseSystemApplication(const QFileInfo& entry){
+        QFile file(entry.filePath());
+        if(!file.open(QIODevice::ReadOnly)){
+            return QVariantMap();
+        }
+        auto data = file.readAll();
+        auto app = QJsonDocument::fromJson(data).object();
+        if(app.isEmpty()){
+            qDebug() << "Invalid file " << entry.filePath();
+            return QVariantMap();
+        }
+        auto name = entry.completeBaseName();
+        app["name"] = name;
+        int type = Foreground;
+        QString typeString = app.contains("type") ? app["type"].toString().toLower() : "";
+        if(typeString == "background"){
+            type = Background;
+        }else if(typeString == "backgroundable"){
+            type = Backgroundable;
+        }else if(!typeString.isEmpty() && typeString != "foreground"){
+            qDebug() << "Invalid type string:" << typeString;
+        }
+        auto bin = app["bin"].toString();
+        auto flags = QStringList() << "system";
+        if(app.contains("flags")){
+            for(auto flag : app["flags"].toArray()){
+                auto value = flag.toString();
+                if(!value.isEmpty() && value != "system"){
+                    flags << value;
+                }
+            }
+        }
+        QVariantMap properties {
+            {"name", name},
+            {"bin", bin},
+            {"type", type},
+            {"flags", flags},
+        };
+        if(app.contains("displayName")){
+            properties.insert("displayName", app["displayName"].toString());
+        }
+        if(app.contains("description")){
+            properties.insert("description", app["description"].toString());
+        }
+        if(app.contains("icon")){
+            properties.insert("icon", app["icon"].toString());
+        }
+        if(app.contains("user")){
+            properties.insert("user", app["user"].toString());
+        }
+        if(app.contains("group")){
+            properties.insert("group", app["group"].toString());
+        }
+        if(app.contains("workingDirectory")){
+            properties.insert("workingDirectory", app["workingDirectory"].toString());
+        }
+        if(app.contains("directories")){
+            QStringList directories;
+            for(auto directory : app["directories"].toArray()){
+                directories.append(directory.toString());
+            }
+            properties.insert("directories", directories);
+        }
+        if(app.contains("permissions")){
+            QStringList permissions;
+            for(auto permission : app["permissions"].toArray()){
+                permissions.append(permission.toString());
+            }
+            properties.insert("permissions", permissions);
+        }
+        if(app.contains("requires")){
+            QStringList dependencies;
+            for(auto dependency : app["requires"].toArray()){
+                dependencies.append(dependency.toString());
+            }
+            properties.insert("requires", dependencies);
+        }
+        if(app.contains("memoryPolicy")){
+            properties.insert("memoryPolicy", app["memoryPolicy"].toString());
+        }
+        if(app.contains("memoryPriority")){
+            properties.insert("memoryPriority", app["memoryPriority"].toInt());
+        }
+        if(app.contains("events")){
+            auto events = app["events"].toObject();
+            for(auto event : events.keys()){
+                if(event == "stop"){
+                    properties.insert("onStop", events[event].toString());
+                }else if(event == "pause"){
+                    properties.insert("onPause", events[event].toString());
+                }else if(event == "resume"){
+                    properties.insert("onResume", events[event].toString());
+                }
+            }
+        }
+        if(app.contains("environment")){
+            QVariantMap envMap;
+            auto environment = app["environment"].toObject();
+            for(auto key : environment.keys()){
+                envMap.insert(key, environment[key].toString());
+            }
+            properties.insert("environment", envMap);
+        }
+        if(app.contains("splash")){
+            properties.insert("splash", app["splash"].toString());
+        }
+        return properties;
+    }
+    void readApplicationCache(){
+        QFile file(applicationCachePath());
+        if(!file.open(QIODevice::ReadOnly)){
+            return;
+        }
+        QDataStream stream(&file);
+        quint32 magic;
+        quint32 version;
+        stream >> magic >> version;
+        if(magic != OXIDE_APPLICATION_CACHE_MAGIC || version != OXIDE_APPLICATION_CACHE_VERSION){
+            qDebug() << "Ignoring outdated application cache";
+            return;
+        }
+        stream >> applicationCache;
+        if(stream.status() != QDataStream::Ok){
+            qDebug() << "Ignoring corrupt application cache";
+            applicationCache.clear();
+        }
+    }
+    void writeApplicationCache(){
+        auto path = applicationCachePath();
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        QSaveFile file(path);
+        if(!file.open(QIODevice::WriteOnly)){
+            qDebug() << "Unable to write application cache" << file.errorString();
+            return;
+        }
+        QDataStream stream(&file);
+        stream << (quint32)OXIDE_APPLICATION_CACHE_MAGIC << (quint32)OXIDE_APPLICATION_CACHE_VERSION << applicationCache;
+        file.commit();
+    }
+    static QString applicationCachePath(){
+        return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/applications.cache";
+    }
     static void migrate(QSettings* settings, int fromVersion){
         if(fromVersion != 0){
             throw "Unknown settings version";
@@ -7,22 +7,22 @@ void button_exit_handler(){
     close(buttons.fd);
 }
 
-void flush_stream(istream* stream){
+void flush_event(event_device& evdev){
     input_event ie;
-    streamsize sie = static_cast<streamsize>(sizeof(struct input_event));
-    stream->read((char*)&ie, sie);
+    ::read(evdev.fd, &ie, sizeof(ie));
 }
-void press_button(event_device& evdev, int code, istream* stream){
+// Only used when there is no virtual device to write to
+void press_button(event_device& evdev, int code){
     qDebug() << "inject button " << code;
     unlock_device(evdev);
     ev_key(evdev, code, 1);
-    flush_stream(stream);
+    flush_event(evdev);
     ev_syn(evdev);
-    flush_stream(stream);
+    flush_event(evdev);
     ev_key(evdev, code, 0);
-    flush_stream(stream);
+    flush_event(evdev);
     ev_syn(evdev);
-    flush_stream(stream);
+    flush_event(evdev);
     lock_device(evdev);
 }
 
@@ -41,48 +41,84 @@ ButtonHandler* ButtonHandler::init(){
         throw QException();
     }
     instance = new ButtonHandler();
-    instance->start();
-    return instance;
-}
-
-void ButtonHandler::run(){
     char name[256];
     memset(name, 0, sizeof(name));
     ioctl(buttons.fd, EVIOCGNAME(sizeof(name)), name);
     qDebug() << "Reading From : " << buttons.device.c_str() << " (" << name << ")";
     lock_device(buttons);
-    qDebug() << "Registering exit handler...";
-    // Mapping the correct button IDs.
-    unordered_map<int, PressRecord> map;
-    map[105] = PressRecord("Left", Qt::Key_Left);
-    map[102] = PressRecord("Middle", Qt::Key_Home);
-    map[106] = PressRecord("Right", Qt::Key_Right);
-    map[116] = PressRecord("Power", Qt::Key_PowerOff);
-
+    MetricsAPI::useMonotonicClock(buttons.fd);
+    // Keys that aren't ours are passed on through the copy, so the device
+    // never has to be ungrabbed
+    instance->output = UInputDevice::clone(buttons.fd);
+    if(instance->output != nullptr){
+        qputenv("OXIDE_BUTTONS_DEVICE", instance->output->path().toUtf8());
+    }
+    instance->map[105] = PressRecord("Left", Qt::Key_Left);
+    instance->map[102] = PressRecord("Middle", Qt::Key_Home);
+    instance->map[106] = PressRecord("Right", Qt::Key_Right);
+    instance->map[116] = PressRecord("Power", Qt::Key_PowerOff);
     qDebug() << "Listening for keypresses...";
-    // Get the size of an input event in the right format!
-    input_event ie;
-    streamsize sie = static_cast<streamsize>(sizeof(struct input_event));
+    if(!inputReactor->addSource(buttons.fd, instance) || !inputReactor->addSource(instance->holdTimer, instance)){
+        throw QException();
+    }
+    return instance;
+}
 
-    while(stream.read((char*)&ie, sie)){
+bool ButtonHandler::readable(int fd){
+    if(fd == holdTimer){
+        // A key that goes up after its deadline counts as held whichever of
+        // the two is read first
+        uint64_t expirations;
+        if(::read(holdTimer, &expirations, sizeof(expirations)) == -1){
+            // Re-armed by a device read earlier in the same batch, so the
+            // expiry it was woken for is gone
+            return errno == EAGAIN || errno == EINTR;
+        }
+        checkHeld();
+        armHoldTimer();
+        return true;
+    }
+    input_event events[BUTTON_READ_SIZE];
+    auto size = ::read(buttons.fd, events, sizeof(events));
+    if(size < 0){
+        if(errno == EINTR){
+            return true;
+        }
+        qDebug() << "Failed to read buttons" << strerror(errno);
+        return false;
+    }
+    for(size_t i = 0; i < size / sizeof(input_event); i++){
+        auto& ie = events[i];
         // TODO - Properly pass through non-button presses
         // Read for non-zero event codes.
         emit rawEvent(ie);
-        if(ie.code != 0){
-            emit activity();
-            // Toggle the button state.
-            map[ie.code].pressed = !map[ie.code].pressed;
-            if(!map[ie.code].pressed && map[ie.code].name == "Unknown"){
-                press_button(buttons, ie.code, &stream);
-            }else if(map[ie.code].pressed){
-                emit keyDown(map[ie.code].keyCode);
-            }else{
-                emit keyUp(map[ie.code].keyCode);
-            }
+        if(ie.type == EV_SYN && ie.code == SYN_DROPPED){
+            // Raised when the clock was changed, and if we fall behind
+            continue;
+        }
+        if(ie.code == 0){
+            continue;
+        }
+        MetricsAPI::input("button.read", MetricsAPI::timestamp(ie));
+        emit activity();
+        // Toggle the button state.
+        map[ie.code].pressed = !map[ie.code].pressed;
+        if(map[ie.code].name == "Unknown" && output != nullptr){
+            input_event events[2] = {ie, ie};
+            events[1].type = EV_SYN;
+            events[1].code = SYN_REPORT;
+            events[1].value = 0;
+            output->write(events, 2);
+        }else if(!map[ie.code].pressed && map[ie.code].name == "Unknown"){
+            press_button(buttons, ie.code);
+        }else if(map[ie.code].pressed){
+            keyDown(map[ie.code].keyCode, MetricsAPI::timestamp(ie));
         }else{
-            yieldCurrentThread();
+            keyUp(map[ie.code].keyCode, MetricsAPI::timestamp(ie));
         }
     }
+    armHoldTimer();
+    return size > 0;
 }
 void ButtonHandler::pressKey(Qt::Key key){
     int code;
@@ -102,5 +138,19 @@ void ButtonHandler::pressKey(Qt::Key key){
         default:
             return;
     }
-    press_button(buttons, code, &stream);
+    if(output == nullptr){
+        press_button(buttons, code);
+        return;
+    }
+    input_event events[4];
+    memset(events, 0, sizeof(events));
+    events[0].type = EV_KEY;
+    events[0].code = code;
+    events[0].value = 1;
+    events[1].type = EV_SYN;
+    events[1].code = SYN_REPORT;
+    events[2] = events[0];
+    events[2].value = 0;
+    events[3] = events[1];
+    output->write(events, 4);
 }
@@ -1,7 +1,7 @@
 #ifndef BUTTONHANDLER_H
 #define BUTTONHANDLER_H
 
-#include <QThread>
+#include <QObject>
 #include <QFile>
 #include <QException>
 #include <QDebug>
@@ -11,7 +11,6 @@
 #include <string>
 #include <iostream>
 #include <unordered_map>
-#include <ext/stdio_filebuf.h>
 #include <linux/input.h>
 #include <unistd.h>
 #include <stdio.h>
@@ -21,14 +20,23 @@
 #include <sys/mman.h>
 #include <linux/fb.h>
 #include <sys/ioctl.h>
+#include <sys/timerfd.h>
 #include <cstdlib>
+#include <algorithm>
 
 #include "event_device.h"
 #include "devicesettings.h"
+#include "inputreactor.h"
+#include "uinputdevice.h"
+#include "metricsapi.h"
 
 using namespace std;
 
 #define buttonHandler ButtonHandler::init()
+// How long a key must be down to count as held, in microseconds
+#define BUTTON_HOLD_TIME 700000
+// Events pulled from the device per read()
+#define BUTTON_READ_SIZE 16
 
 struct PressRecord {
     bool pressed = false;
@@ -42,17 +50,25 @@ struct PressRecord {
 static event_device buttons(deviceSettings.getButtonsDevicePath(), O_RDWR);
 
 
-class ButtonHandler : public QThread {
+class ButtonHandler : public QObject, public InputSource {
     Q_OBJECT
 
 public:
     static ButtonHandler* init();
 
-    ButtonHandler() : QThread(), filebuf(buttons.fd, ios::in), stream(&filebuf), pressed(), timer(this), m_enabled(true) {
-        timer.setInterval(100);
-        timer.setSingleShot(false);
-        connect(&timer, &QTimer::timeout, this, &ButtonHandler::timeout);
-        timer.start();
+    ButtonHandler() : QObject(), map(), output(nullptr), pressed(), m_enabled(true) {
+        qRegisterMetaType<Qt::Key>();
+        holdTimer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if(holdTimer == -1){
+            qDebug() << "Unable to create hold timer" << strerror(errno);
+            throw QException();
+        }
+    }
+    ~ButtonHandler(){
+        close(holdTimer);
+        if(output != nullptr){
+            delete output;
+        }
     }
     void setEnabled(bool enabled){
         m_enabled = enabled;
@@ -61,86 +77,90 @@ public:
 public slots:
     void pressKey(Qt::Key);
 
-private slots:
-    void keyDown(Qt::Key key){
+signals:
+    // timestamp is when the key had been down long enough, in CLOCK_MONOTONIC
+    // microseconds
+    void held(Qt::Key key, qint64 timestamp);
+    void powerPress();
+    void activity();
+    void rawEvent(const input_event&);
+
+protected:
+    bool readable(int fd) override;
+    // Mapping the correct button IDs
+    unordered_map<int, PressRecord> map;
+    // What applications read, the real device stays grabbed
+    UInputDevice* output;
+    // When each key that could still be held went down, only touched from the
+    // input reactor's thread
+    QMap<Qt::Key, qint64> pressed;
+    // Armed for the earliest hold deadline, so nothing wakes while a key is
+    // down until it has actually been held
+    int holdTimer;
+    const QSet<Qt::Key> validKeys { Qt::Key_Left, Qt::Key_Home, Qt::Key_Right, Qt::Key_PowerOff };
+    bool m_enabled;
+
+    // timestamp is from the input event, in CLOCK_MONOTONIC microseconds
+    void keyDown(Qt::Key key, qint64 timestamp){
         if(!m_enabled){
             return;
         }
         qDebug() << "Down" << key;
         if(validKeys.contains(key) && !pressed.contains(key)){
-            QElapsedTimer timer;
-            timer.start();
-            pressed.insert(key, timer);
+            pressed.insert(key, timestamp);
         }
     }
-    void keyUp(Qt::Key key){
+    void keyUp(Qt::Key key, qint64 timestamp){
         if(!m_enabled){
             return;
         }
         qDebug() << "Up" << key;
         if(!pressed.contains(key)){
-            // This should never happen
+            // Held event already fired
             return;
         }
         auto value = pressed.value(key);
-        pressed.remove(key);
-        if(value.hasExpired(700)){
-            // Held event already fired
+        if(timestamp - value >= BUTTON_HOLD_TIME){
+            // Released after the deadline but before the timer was handled
+            keyHeld(key);
             return;
         }
+        pressed.remove(key);
         if(key == Qt::Key_PowerOff){
             emit powerPress();
             return;
         }
         pressKey(key);
     }
-    void timeout(){
+    void keyHeld(Qt::Key key){
+        auto deadline = pressed.take(key) + BUTTON_HOLD_TIME;
+        qDebug() << "Key held" << key;
+        MetricsAPI::input("button.hold", deadline);
+        emit held(key, deadline);
+    }
+    void checkHeld(){
         if(!m_enabled){
+            pressed.clear();
             return;
         }
+        auto now = MetricsAPI::now();
         for(auto key : pressed.keys()){
-            // If the key has been held for a while
-            if(!pressed.value(key).hasExpired(700)){
-                continue;
+            if(now >= pressed.value(key) + BUTTON_HOLD_TIME){
+                keyHeld(key);
             }
-            qDebug() << "Key held" << key;
-            switch(key){
-                case Qt::Key_Left:
-                    emit leftHeld();
-                break;
-                case Qt::Key_Home:
-                    emit homeHeld();
-                break;
-                case Qt::Key_Right:
-                    emit rightHeld();
-                break;
-                case Qt::Key_PowerOff:
-                    emit powerHeld();
-                break;
-                default:
-                    continue;
-            }
-            pressed.remove(key);
         }
     }
-
-signals:
-    void leftHeld();
-    void homeHeld();
-    void rightHeld();
-    void powerHeld();
-    void powerPress();
-    void activity();
-    void rawEvent(const input_event&);
-
-protected:
-    void run();
-    __gnu_cxx::stdio_filebuf<char> filebuf;
-    istream stream;
-    QMap<Qt::Key, QElapsedTimer> pressed;
-    QTimer timer;
-    const QSet<Qt::Key> validKeys { Qt::Key_Left, Qt::Key_Home, Qt::Key_Right, Qt::Key_PowerOff };
-    bool m_enabled;
+    void armHoldTimer(){
+        itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        if(!pressed.isEmpty()){
+            auto deadline = *std::min_element(pressed.cbegin(), pressed.cend()) + BUTTON_HOLD_TIME;
+            spec.it_value.tv_sec = deadline / 1000000;
+            spec.it_value.tv_nsec = deadline % 1000000 * 1000;
+        }
+        // An all zero value disarms it
+        timerfd_settime(holdTimer, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
 };
 
 #endif // BUTTONHANDLER_H
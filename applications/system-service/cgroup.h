@@ -0,0 +1,139 @@
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QThread>
+
+#include <string>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#define CGROUP_MOUNT "/sys/fs/cgroup"
+#define CGROUP_FOREGROUND_WEIGHT 1000
+#define CGROUP_BACKGROUND_WEIGHT 100
+// How many times to signal what is left in a group before giving up, and
+// the milliseconds to wait between them
+#define CGROUP_KILL_TRIES 10
+#define CGROUP_KILL_INTERVAL 10
+
+// A cgroup v2 group for a single application.
+//
+// tarnish needs a delegated subtree (Delegate=yes in tarnish.service) and a
+// kernel with the cgroup v2 freezer (5.2+). Without those available() is false
+// and callers fall back to signalling the process group.
+class Cgroup {
+public:
+    static bool available(){ return !root().isEmpty(); }
+    static const QString& root(){
+        static QString instance = setupRoot();
+        return instance;
+    }
+    Cgroup(const QString& name)
+    : m_path(root() + "/app-" + name),
+      m_procs((m_path + "/cgroup.procs").toStdString()) {
+        if(!QDir().mkpath(m_path)){
+            qWarning() << "Unable to create cgroup" << m_path;
+        }
+    }
+    ~Cgroup(){
+        if(rmdir(m_path.toStdString().c_str())){
+            qDebug() << "Unable to remove cgroup" << m_path << ::strerror(errno);
+        }
+    }
+    const QString& path(){ return m_path; }
+    QString eventsPath(){ return m_path + "/cgroup.events"; }
+    // Safe to call between fork and exec
+    bool join() const{
+        int fd = open(m_procs.c_str(), O_WRONLY | O_CLOEXEC);
+        if(fd == -1){
+            return false;
+        }
+        bool ok = ::write(fd, "0", 1) == 1;
+        close(fd);
+        return ok;
+    }
+    bool freeze(bool frozen){ return write("cgroup.freeze", frozen ? "1" : "0"); }
+    bool isFrozen(){ return read("cgroup.events").contains("frozen 1"); }
+    bool isPopulated(){ return read("cgroup.events").contains("populated 1"); }
+    bool setWeight(int weight){ return write("cpu.weight", QByteArray::number(weight)); }
+    bool setMemoryHigh(qulonglong bytes){ return write("memory.high", bytes ? QByteArray::number(bytes) : "max"); }
+    // Kills everything in the group, false if anything is still left
+    bool kill(){
+        // cgroup.kill is only there from 5.14, it's done in the kernel then
+        if(write("cgroup.kill", "1")){
+            return true;
+        }
+        // Processes can fork while we go through the list, and take a moment
+        // to leave the group once killed
+        for(int i = 0; i < CGROUP_KILL_TRIES && isPopulated(); i++){
+            for(auto pid : read("cgroup.procs").split('\n')){
+                if(!pid.isEmpty()){
+                    ::kill(pid.toInt(), SIGKILL);
+                }
+            }
+            QThread::msleep(CGROUP_KILL_INTERVAL);
+        }
+        return !isPopulated();
+    }
+
+private:
+    QString m_path;
+    std::string m_procs;
+
+    bool write(const QString& name, const QByteArray& value){ return writeFile(m_path + "/" + name, value); }
+    QByteArray read(const QString& name){
+        QFile file(m_path + "/" + name);
+        if(!file.open(QIODevice::ReadOnly)){
+            return QByteArray();
+        }
+        return file.readAll();
+    }
+    static bool writeFile(const QString& path, const QByteArray& value){
+        QFile file(path);
+        if(!file.open(QIODevice::WriteOnly) || file.write(value) != value.size()){
+            return false;
+        }
+        file.close();
+        return file.error() == QFile::NoError;
+    }
+    static QString setupRoot(){
+        if(!QFile::exists(CGROUP_MOUNT "/cgroup.controllers")){
+            qDebug() << "cgroup v2 is not available";
+            return QString();
+        }
+        QFile self("/proc/self/cgroup");
+        if(!self.open(QIODevice::ReadOnly)){
+            return QString();
+        }
+        QString base;
+        for(auto line : self.readAll().split('\n')){
+            if(line.startsWith("0::")){
+                base = CGROUP_MOUNT + QString(line.mid(3)).trimmed();
+            }
+        }
+        if(base.isEmpty() || !QFile::exists(base + "/cgroup.freeze")){
+            qDebug() << "cgroup freezer is not available";
+            return QString();
+        }
+        // Processes can't live in a group that has controllers enabled for its
+        // children, so tarnish moves into a leaf of its own first
+        auto service = base + "/tarnish";
+        if(!QDir().mkpath(service) || !writeFile(service + "/cgroup.procs", "0")){
+            qDebug() << "Unable to move tarnish into its own cgroup, is the subtree delegated?";
+            return QString();
+        }
+        if(!writeFile(base + "/cgroup.subtree_control", "+cpu")){
+            qDebug() << "Unable to enable cpu controller";
+        }
+        if(!writeFile(base + "/cgroup.subtree_control", "+memory")){
+            qDebug() << "Unable to enable memory controller";
+        }
+        qDebug() << "Using cgroup" << base;
+        return base;
+    }
+};
+
+#endif // CGROUP_H
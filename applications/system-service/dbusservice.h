@@ -19,6 +19,7 @@
 #include "systemapi.h"
 #include "screenapi.h"
 #include "notificationapi.h"
+#include "metricsapi.h"
 #include "buttonhandler.h"
 #include "digitizerhandler.h"
 
@@ -76,6 +77,12 @@ public:
         return instance;
     }
     DBusService(QObject* parent) : APIBase(parent), apis(){
+        // Applications record their timings as soon as they are created
+        apis.insert("metrics", APIEntry{
+            .path = QString(OXIDE_SERVICE_PATH) + "/metrics",
+            .dependants = new QStringList(),
+            .instance = new MetricsAPI(this),
+        });
         apis.insert("wifi", APIEntry{
             .path = QString(OXIDE_SERVICE_PATH) + "/wifi",
             .dependants = new QStringList(),
@@ -86,6 +93,9 @@ public:
             .dependants = new QStringList(),
             .instance = new SystemAPI(this),
         });
+        // Applications inherit the paths of the virtual input devices, so
+        // they have to exist before any are created
+        ButtonHandler::init();
         apis.insert("power", APIEntry{
             .path = QString(OXIDE_SERVICE_PATH) + "/power",
             .dependants = new QStringList(),
@@ -107,10 +117,7 @@ public:
             .instance = new NotificationAPI(this),
         });
 
-        connect(buttonHandler, &ButtonHandler::leftHeld, systemAPI, &SystemAPI::leftAction);
-        connect(buttonHandler, &ButtonHandler::homeHeld, systemAPI, &SystemAPI::homeAction);
-        connect(buttonHandler, &ButtonHandler::rightHeld, systemAPI, &SystemAPI::rightAction);
-        connect(buttonHandler, &ButtonHandler::powerHeld, systemAPI, &SystemAPI::powerAction);
+        connect(buttonHandler, &ButtonHandler::held, systemAPI, &SystemAPI::buttonHeld);
         connect(buttonHandler, &ButtonHandler::powerPress, systemAPI, &SystemAPI::suspend);
         connect(buttonHandler, &ButtonHandler::activity, systemAPI, &SystemAPI::activity);
         connect(powerAPI, &PowerAPI::chargerStateChanged, systemAPI, &SystemAPI::activity);
@@ -231,6 +238,8 @@ private slots:
                 }
             }
             systemAPI->uninhibitAll(name);
+            systemAPI->releasePenRing(name);
+            APIBase::forgetSender(name);
         }
     }
 
@@ -20,5 +20,6 @@
 #define OXIDE_NOTIFICATIONS_INTERFACE OXIDE_SERVICE ".Notifications"
 #define OXIDE_NOTIFICATION_INTERFACE OXIDE_SERVICE ".Notification"
 #define OXIDE_SCREENSHOT_INTERFACE OXIDE_SERVICE ".Screenshot"
+#define OXIDE_METRICS_INTERFACE OXIDE_SERVICE ".Metrics"
 
 #endif // DBUSSETTINGS_H
@@ -2,24 +2,49 @@
 #ifndef DIGITIZERHANDLER_H
 #define DIGITIZERHANDLER_H
 
-#include <QThread>
+#include <QObject>
 #include <QException>
 
-#include <ext/stdio_filebuf.h>
 #include <sstream>
 #include <linux/input.h>
 #include <iostream>
 #include <string>
+#include <atomic>
+#include <algorithm>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
 
 #include "event_device.h"
 #include "devicesettings.h"
+#include "inputring.h"
+#include "penringwriter.h"
+#include "gestureengine.h"
+#include "touchtracker.h"
+#include "inputreactor.h"
+#include "uinputdevice.h"
+#include "metricsapi.h"
 
 using namespace std;
 
 #define touchHandler DigitizerHandler::singleton_touchScreen()
 #define wacomHandler DigitizerHandler::singleton_wacom()
 
-class DigitizerHandler : public QThread {
+// Events pulled from the device per read()
+#define DIGITIZER_READ_SIZE 64
+// Longest frame that will be passed on, anything longer is dropped
+#define DIGITIZER_FRAME_SIZE 256
+#define DIGITIZER_RING_SIZE 4096
+// Frames that the main thread has no interest in still wake it this often, in
+// microseconds, so it can track activity
+#define DIGITIZER_ACTIVITY_INTERVAL 1000000
+// How evdev sizes each client's buffer, see evdev_compute_buffer_size()
+#define EVDEV_BUF_PACKETS 8
+#define EVDEV_MIN_BUFFER_SIZE 64
+// Used when the device can't be queried
+#define DEFAULT_FLOOD_SIZE 512 * 8 * 4
+
+class DigitizerHandler : public QObject, public InputSource {
     Q_OBJECT
 public:
     static DigitizerHandler* singleton_touchScreen(){
@@ -33,8 +58,11 @@ public:
             qDebug() << "Failed to open event device: " << touchScreen_device.device.c_str();
             throw QException();
         }
-        instance = new DigitizerHandler(touchScreen_device);
-        instance->start();
+        // Gestures are recognised on the input thread, the main thread only
+        // needs to know the screen is in use
+        instance = new DigitizerHandler(touchScreen_device, "touch.read", {}, true);
+        instance->listen();
+        instance->exportPath("OXIDE_TOUCH_DEVICE");
         return instance;
     }
     static DigitizerHandler* singleton_wacom(){
@@ -48,56 +76,117 @@ public:
             qDebug() << "Failed to open event device: " << wacom_device.device.c_str();
             throw QException();
         }
-        instance = new DigitizerHandler(wacom_device);
-        instance->start();
+        // The main thread only follows the pen in and out of range, and
+        // each stroke for activity. Nothing is ever kept from applications, so
+        // they read the device directly and we stay off the pen's path.
+        instance = new DigitizerHandler(wacom_device, "pen.read", {BTN_TOOL_PEN, BTN_TOUCH}, false);
+        instance->listen();
         return instance;
     }
     static string exec(const char* cmd);
     static vector<std::string> split_string_by_newline(const std::string& str);
     static int is_uint(string input);
 
-    DigitizerHandler(event_device& device)
-     : QThread(),
-       filebuf(device.fd, ios::in),
-       stream(&filebuf),
+    // With copy set applications read a uinput copy of the device, so gestures
+    // can keep touches from them
+    DigitizerHandler(event_device& device, const char* readStage, const QList<int>& interestingKeys, bool copy)
+     : QObject(),
        m_enabled(true),
-       device(device) {
+       device(device),
+       readStage(readStage),
+       interestingKeys(interestingKeys),
+       lastActivity(0),
+       ring(),
+       notified(false),
+       frameSize(0),
+       dropping(false),
+       floodFrames(0),
+       gestureEngine(nullptr),
+       penRing(nullptr),
+       output(nullptr),
+       inputSlot(0),
+       inputTouches(0),
+       outputSlot(0),
+       outputTouches(0),
+       holding(false),
+       releaseRequested(false),
+       masked(false),
+       maskRequested(false) {
+        MetricsAPI::useMonotonicClock(device.fd);
+        deadlineTimer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        control = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if(deadlineTimer == -1 || control == -1){
+            qDebug() << "Unable to create input timers" << strerror(errno);
+            throw QException();
+        }
+        floodSize = clientBufferSize();
         flood = build_flood();
+        qDebug() << "Event buffer for" << device.device.c_str() << "holds" << floodSize << "events";
+        syncTouches();
+        if(!copy){
+            return;
+        }
+        output = UInputDevice::clone(device.fd);
+        if(output == nullptr){
+            qDebug() << "Applications will read" << device.device.c_str() << "directly, gestures will reach them";
+            return;
+        }
+        // Held for as long as we run, applications read the copy
+        lock_device(this->device);
+        outputSlot = inputSlot;
+        // Whatever is down now was never passed on
+        holding = inputTouches;
     }
     ~DigitizerHandler(){
+        close(deadlineTimer);
+        close(control);
+        if(output != nullptr){
+            delete output;
+        }
         if(device.fd == -1){
             return;
         }
         if(device.locked){
-            ungrab();
+            unlock_device(device);
         }
         close(device.fd);
     }
     void setEnabled(bool enabled){
         m_enabled = enabled;
     }
-    void grab(){
-        if(!grabbed()){
-            lock_device(device);
-        }
+    // Frames are handed to the engine on the input thread before anything else
+    // sees them, applications stop seeing a touch once the engine claims it
+    void setGestureEngine(GestureEngine* engine){
+        gestureEngine.store(engine);
+        updateMask();
     }
-    void ungrab(){
-        if(grabbed()){
-            unlock_device(device);
+    // Every whole frame is also decoded into the ring on the input thread
+    void setPenRing(PenRingWriter* writer){
+        if(writer != nullptr){
+            writer->sync(device.fd);
         }
+        penRing.store(writer);
+        updateMask();
     }
-    bool grabbed() { return device.locked; }
-    void write(ushort type, ushort code, int value){
-        auto event = createEvent(type, code, value);
-        ::write(device.fd, &event, sizeof(input_event));
-        qDebug() << "Emitted event " << event.time.tv_sec << event.time.tv_usec << type << code << value;
-    }
-    void write(input_event* events, size_t size){
-        ::write(device.fd, events, size);
+    // When nothing in tarnish needs every event, the kernel is asked for only
+    // the keys the main thread wants. Call whenever that could have changed,
+    // safe to call from any thread.
+    void updateMask(){
+        maskRequested.store(true);
+        uint64_t value = 1;
+        ::write(control, &value, sizeof(value));
     }
-    void syn(){
-        write(EV_SYN, SYN_REPORT, 0);
+    // Number of multitouch slots the device reports
+    int slotCount(){
+        input_absinfo info;
+        if(ioctl(device.fd, EVIOCGABS(ABS_MT_SLOT), &info) == -1){
+            return 1;
+        }
+        return info.maximum + 1;
     }
+    // The copy applications read, empty if it couldn't be created
+    QString virtualPath(){ return output == nullptr ? QString() : output->path(); }
+    // Safe to call from any thread
     void clear_buffer(){
         if(device.fd == -1){
             return;
@@ -105,7 +194,19 @@ public:
 #ifdef DEBUG
         qDebug() << "Clearing event buffer on" << device.device.c_str();
 #endif
-        write(flood, 512 * 8 * 4 * sizeof(input_event));
+        // Overflow every reader's buffer, the kernel then drops whatever they
+        // haven't read yet and reports SYN_DROPPED so they resync
+        if(output == nullptr){
+            floodFrames.store(floodSize / 2);
+            ::write(device.fd, flood, floodSize * sizeof(input_event));
+            return;
+        }
+        output->write(flood, floodSize);
+        // Anything still down is released on the input thread, which is the
+        // only one that knows what applications have seen
+        releaseRequested.store(true);
+        uint64_t value = 1;
+        ::write(control, &value, sizeof(value));
     }
     static inline input_event createEvent(ushort type, ushort code, int value){
         struct input_event event;
@@ -115,51 +216,433 @@ public:
         return event;
     }
 
+    // Called from the thread that receives framesAvailable. Frames are only
+    // ever added whole, so reading until this returns 0 never stops mid frame.
+    size_t readEvents(input_event* events, size_t max){
+        // Clear first so a frame pushed while draining raises a new signal
+        notified.store(false, std::memory_order_release);
+        return ring.pop(events, max);
+    }
+
 signals:
-    void activity();
-    void inputEvent(const input_event& event);
+    // Raised once until readEvents is called, no matter how many frames arrive
+    void framesAvailable();
 
 protected:
     input_event* flood;
+    size_t floodSize;
     input_event* build_flood(){
-        auto n = 512 * 8;
-        auto num_inst = 4;
-        input_event* ev = (input_event *)malloc(sizeof(struct input_event) * n * num_inst);
-        memset(ev, 0, sizeof(input_event) * n * num_inst);
-        auto i = 0;
-        while (i < n) {
+        input_event* ev = (input_event *)malloc(sizeof(struct input_event) * floodSize);
+        size_t i = 0;
+        // The value has to change each time or the input core filters it out
+        while (i + 4 <= floodSize) {
             ev[i++] = createEvent(EV_ABS, ABS_DISTANCE, 1);
             ev[i++] = createEvent(EV_SYN, 0, 0);
             ev[i++] = createEvent(EV_ABS, ABS_DISTANCE, 2);
             ev[i++] = createEvent(EV_SYN, 0, 0);
         }
+        floodSize = i;
         return ev;
     }
-    void run(){
+    // Mirrors input_estimate_events_per_packet() and
+    // evdev_compute_buffer_size() in the kernel
+    size_t clientBufferSize(){
+        uint8_t evBits[EV_CNT / 8 + 1];
+        uint8_t absBits[ABS_CNT / 8 + 1];
+        uint8_t relBits[REL_CNT / 8 + 1];
+        memset(evBits, 0, sizeof(evBits));
+        memset(absBits, 0, sizeof(absBits));
+        memset(relBits, 0, sizeof(relBits));
+        if(
+            ioctl(device.fd, EVIOCGBIT(0, sizeof(evBits)), evBits) == -1
+            || ioctl(device.fd, EVIOCGBIT(EV_ABS, sizeof(absBits)), absBits) == -1
+            || ioctl(device.fd, EVIOCGBIT(EV_REL, sizeof(relBits)), relBits) == -1
+        ){
+            return DEFAULT_FLOOD_SIZE;
+        }
+        auto hasBit = [](const uint8_t* bits, int bit){ return bits[bit / 8] & (1 << (bit % 8)); };
+        input_absinfo info;
+        size_t slotTotal = 0;
+        size_t hint = 0;
+        if(hasBit(absBits, ABS_MT_SLOT) && ioctl(device.fd, EVIOCGABS(ABS_MT_SLOT), &info) != -1){
+            slotTotal = info.maximum - info.minimum + 1;
+            // input_mt_init_slots() hints this many events per slot
+            hint = slotTotal * 6;
+        }else if(hasBit(absBits, ABS_MT_TRACKING_ID) && ioctl(device.fd, EVIOCGABS(ABS_MT_TRACKING_ID), &info) != -1){
+            slotTotal = qBound(2, info.maximum - info.minimum + 1, 32);
+        }else if(hasBit(absBits, ABS_MT_POSITION_X)){
+            slotTotal = 2;
+        }
+        size_t events = slotTotal + 1;
+        if(hasBit(evBits, EV_ABS)){
+            for(int i = 0; i < ABS_CNT; i++){
+                if(hasBit(absBits, i)){
+                    auto mt = i == ABS_MT_SLOT || (i >= ABS_MT_TOUCH_MAJOR && i <= ABS_MT_TOOL_Y);
+                    events += mt ? slotTotal : 1;
+                }
+            }
+        }
+        if(hasBit(evBits, EV_REL)){
+            for(int i = 0; i < REL_CNT; i++){
+                if(hasBit(relBits, i)){
+                    events++;
+                }
+            }
+        }
+        events += 7;
+        auto size = std::max(std::max(events, hint) * EVDEV_BUF_PACKETS, (size_t)EVDEV_MIN_BUFFER_SIZE);
+        size_t buffer = 1;
+        while(buffer < size){
+            buffer <<= 1;
+        }
+        return buffer;
+    }
+    // Starts reading on the input reactor's thread
+    void listen(){
         char name[256];
         memset(name, 0, sizeof(name));
         ioctl(device.fd, EVIOCGNAME(sizeof(name)), name);
         qDebug() << "Reading From : " << device.device.c_str() << " (" << name << ")";
-        qDebug() << "Listening for events...";
-        while(handle_events()){
-            yieldCurrentThread();
+        if(
+            !inputReactor->addSource(device.fd, this)
+            || !inputReactor->addSource(deadlineTimer, this)
+            || !inputReactor->addSource(control, this)
+        ){
+            throw QException();
+        }
+        updateMask();
+    }
+    // Applications started from now on open the copy
+    void exportPath(const char* variable){
+        if(output != nullptr){
+            qputenv(variable, output->path().toUtf8());
         }
     }
+    bool readable(int fd) override{
+        uint64_t value;
+        if(fd == control){
+            ::read(control, &value, sizeof(value));
+            if(releaseRequested.exchange(false)){
+                hold();
+            }
+            if(maskRequested.exchange(false)){
+                applyMask();
+            }
+            return true;
+        }
+        if(fd != deadlineTimer){
+            return handle_events();
+        }
+        if(::read(deadlineTimer, &value, sizeof(value)) == -1){
+            // Re-armed by a device read earlier in the same batch, so the
+            // expiry it was woken for is gone
+            return errno == EAGAIN || errno == EINTR;
+        }
+        auto engine = gestureEngine.load();
+        if(engine != nullptr){
+            engine->checkDeadline();
+            if(engine->claimed()){
+                hold();
+            }
+            armDeadline(engine);
+        }
+        return true;
+    }
     bool handle_events(){
-        input_event event;
-        if(!read(&event)){
+        auto engine = gestureEngine.load();
+        auto writer = penRing.load();
+        input_event events[DIGITIZER_READ_SIZE];
+        auto size = ::read(device.fd, events, sizeof(events));
+        if(size < 0){
+            return errno == EINTR;
+        }
+        if(!size){
             return false;
         }
-        emit inputEvent(event);
-        emit activity();
+        bool notify = false;
+        for(size_t i = 0; i < size / sizeof(input_event); i++){
+            auto& event = events[i];
+            if(event.type == EV_SYN && event.code == SYN_DROPPED){
+                // The kernel lost events, throw away everything up to the next report
+                frameSize = 0;
+                dropping = true;
+                continue;
+            }
+            if(!dropping){
+                if(frameSize < DIGITIZER_FRAME_SIZE){
+                    frame[frameSize++] = event;
+                }else{
+                    qDebug() << "Dropping oversized input frame on" << device.device.c_str();
+                    frameSize = 0;
+                    dropping = true;
+                }
+            }
+            if(event.type != EV_SYN || event.code != SYN_REPORT){
+                continue;
+            }
+            if(dropping){
+                // Whatever was lost may have changed what is down
+                syncTouches();
+                resyncOutput();
+                if(writer != nullptr){
+                    writer->sync(device.fd);
+                }
+            }
+            if(!dropping && isFloodFrame()){
+                // Our own flood from clear_buffer, nobody in tarnish wants it
+                floodFrames--;
+            }else if(!dropping){
+                floodFrames.store(0);
+                auto timestamp = MetricsAPI::timestamp(event);
+                MetricsAPI::input(readStage, timestamp);
+                auto slot = inputSlot;
+                trackTouches(frame, frameSize, inputSlot, inputTouches);
+                if(engine != nullptr){
+                    engine->processFrame(frame, frameSize);
+                    if(engine->claimed()){
+                        hold();
+                    }
+                }
+                if(!holding){
+                    forward(slot);
+                }else if(!inputTouches){
+                    // Everything has been lifted, the next touch is passed on
+                    holding = false;
+                }
+                if(writer != nullptr){
+                    writer->processFrame(frame, frameSize);
+                }
+                if(!isInteresting()){
+                    // Nothing the main thread reads, only let it know there
+                    // was activity now and then
+                    if(timestamp - lastActivity >= DIGITIZER_ACTIVITY_INTERVAL){
+                        lastActivity = timestamp;
+                        notify = true;
+                    }
+                }else if(ring.push(frame, frameSize)){
+                    lastActivity = timestamp;
+                    notify = true;
+                }else{
+                    qDebug() << "Input ring full, dropping frame on" << device.device.c_str();
+                }
+            }
+            frameSize = 0;
+            dropping = false;
+        }
+        if(engine != nullptr){
+            armDeadline(engine);
+        }
+        if(writer != nullptr){
+            writer->wake();
+        }
+        if(notify && !notified.exchange(true, std::memory_order_acq_rel)){
+            emit framesAvailable();
+        }
         return true;
     }
-    __gnu_cxx::stdio_filebuf<char> filebuf;
-    istream stream;
     bool m_enabled;
     event_device device;
-    bool read(input_event* ie){
-        return (bool)stream.read((char*)ie, static_cast<streamsize>(sizeof(struct input_event)));
+    // A string literal, see MetricsAPI::input()
+    const char* readStage;
+    // EV_KEY codes that get a frame passed to the main thread
+    QList<int> interestingKeys;
+    // When the main thread was last woken, in CLOCK_MONOTONIC microseconds
+    qint64 lastActivity;
+    InputFrameRing<DIGITIZER_RING_SIZE> ring;
+    std::atomic<bool> notified;
+    input_event frame[DIGITIZER_FRAME_SIZE];
+    size_t frameSize;
+    bool dropping;
+    std::atomic<size_t> floodFrames;
+    std::atomic<GestureEngine*> gestureEngine;
+    // Armed for the engine's next deadline, like a long press
+    int deadlineTimer;
+    std::atomic<PenRingWriter*> penRing;
+    // Written to by clear_buffer to wake the input thread
+    int control;
+    UInputDevice* output;
+    // What is down on the device and what applications have been shown, only
+    // touched on the input thread. Slots are a mask of tracking IDs in use.
+    int inputSlot;
+    quint32 inputTouches;
+    int outputSlot;
+    quint32 outputTouches;
+    // Set while the touches that are down shouldn't reach applications
+    bool holding;
+    std::atomic<bool> releaseRequested;
+    // Set while the kernel only sends interestingKeys
+    bool masked;
+    std::atomic<bool> maskRequested;
+
+    static void trackTouches(const input_event* events, size_t count, int& slot, quint32& touches){
+        for(size_t i = 0; i < count; i++){
+            auto& event = events[i];
+            if(event.type != EV_ABS){
+                continue;
+            }
+            if(event.code == ABS_MT_SLOT){
+                slot = event.value;
+            }else if(event.code == ABS_MT_TRACKING_ID && slot >= 0 && slot < TOUCH_MAX_SLOTS){
+                if(event.value == -1){
+                    touches &= ~(1u << slot);
+                }else{
+                    touches |= 1u << slot;
+                }
+            }
+        }
+    }
+    void syncTouches(){
+        input_absinfo info;
+        if(ioctl(device.fd, EVIOCGABS(ABS_MT_SLOT), &info) == -1){
+            return;
+        }
+        inputSlot = info.value;
+        struct {
+            __u32 code;
+            __s32 values[TOUCH_MAX_SLOTS];
+        } request;
+        request.code = ABS_MT_TRACKING_ID;
+        if(ioctl(device.fd, EVIOCGMTSLOTS(sizeof(request)), &request) == -1){
+            return;
+        }
+        auto slotTotal = std::min(slotCount(), TOUCH_MAX_SLOTS);
+        inputTouches = 0;
+        for(int slot = 0; slot < slotTotal; slot++){
+            if(request.values[slot] != -1){
+                inputTouches |= 1u << slot;
+            }
+        }
+    }
+    // Passes the current frame on. slot is the device's slot before the
+    // frame, the kernel leaves out ABS_MT_SLOT when it hasn't changed.
+    void forward(int slot){
+        if(output == nullptr){
+            return;
+        }
+        input_event events[DIGITIZER_FRAME_SIZE + 1];
+        size_t count = 0;
+        auto startsWithSlot = frameSize && frame[0].type == EV_ABS && frame[0].code == ABS_MT_SLOT;
+        if(slot != outputSlot && !startsWithSlot){
+            events[count++] = createEvent(EV_ABS, ABS_MT_SLOT, slot);
+        }
+        memcpy(events + count, frame, frameSize * sizeof(input_event));
+        count += frameSize;
+        trackTouches(events, count, outputSlot, outputTouches);
+        output->write(events, count);
+    }
+    // Lifts everything applications think is down, and keeps the rest of the
+    // touch from them
+    void hold(){
+        if(holding){
+            return;
+        }
+        holding = inputTouches;
+        release(outputTouches);
+    }
+    // Called after syncTouches() when the kernel dropped events, so what
+    // applications were shown may no longer match the device
+    void resyncOutput(){
+        if(output == nullptr){
+            return;
+        }
+        if(holding){
+            // Lifted while events were lost
+            holding = inputTouches;
+            return;
+        }
+        if(inputTouches & ~outputTouches){
+            // Went down while events were lost, applications never saw where
+            hold();
+            return;
+        }
+        release(outputTouches & ~inputTouches);
+    }
+    // Lifts touches on the copy
+    void release(quint32 touches){
+        if(output == nullptr || !touches){
+            return;
+        }
+        input_event events[TOUCH_MAX_SLOTS * 2 + 2];
+        size_t count = 0;
+        for(int slot = 0; slot < TOUCH_MAX_SLOTS; slot++){
+            if(touches & (1u << slot)){
+                events[count++] = createEvent(EV_ABS, ABS_MT_SLOT, slot);
+                events[count++] = createEvent(EV_ABS, ABS_MT_TRACKING_ID, -1);
+            }
+        }
+        if(touches == outputTouches){
+            // Filtered out by the kernel if the device doesn't have it
+            events[count++] = createEvent(EV_KEY, BTN_TOUCH, 0);
+        }
+        events[count++] = createEvent(EV_SYN, SYN_REPORT, 0);
+        trackTouches(events, count, outputSlot, outputTouches);
+        output->write(events, count);
+    }
+
+    void armDeadline(GestureEngine* engine){
+        itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        auto timeout = engine->msecsUntilDeadline();
+        if(timeout > 0){
+            spec.it_value.tv_sec = timeout / 1000;
+            spec.it_value.tv_nsec = timeout % 1000 * 1000000;
+        }else if(!timeout){
+            // Already due, zero would disarm it
+            spec.it_value.tv_nsec = 1;
+        }
+        timerfd_settime(deadlineTimer, 0, &spec, nullptr);
+    }
+
+    bool isInteresting(){
+        for(size_t i = 0; i < frameSize; i++){
+            if(frame[i].type == EV_KEY && interestingKeys.contains(frame[i].code)){
+                return true;
+            }
+        }
+        return false;
+    }
+    // Only called on the input thread
+    void applyMask(){
+        auto writer = penRing.load();
+        // Forwarding, gestures and pen ring clients all need every event
+        auto everything = output != nullptr
+            || gestureEngine.load() != nullptr
+            || (writer != nullptr && writer->hasClients());
+        if(everything != masked){
+            return;
+        }
+        uint8_t types[EV_CNT / 8 + 1];
+        uint8_t keys[KEY_CNT / 8 + 1];
+        memset(types, everything ? 0xff : 0, sizeof(types));
+        memset(keys, everything ? 0xff : 0, sizeof(keys));
+        if(!everything){
+            types[EV_KEY / 8] |= 1 << (EV_KEY % 8);
+            for(auto key : interestingKeys){
+                keys[key / 8] |= 1 << (key % 8);
+            }
+        }
+        // Masks for EV_SYN are a mask of types, EV_SYN itself is never filtered
+        input_mask typeMask{EV_SYN, sizeof(types), (__u64)(uintptr_t)types};
+        input_mask keyMask{EV_KEY, sizeof(keys), (__u64)(uintptr_t)keys};
+        if(ioctl(device.fd, EVIOCSMASK, &keyMask) == -1 || ioctl(device.fd, EVIOCSMASK, &typeMask) == -1){
+            qDebug() << "Unable to filter events on" << device.device.c_str() << strerror(errno);
+            return;
+        }
+        masked = !everything;
+        qDebug() << (masked ? "Reading only keys from" : "Reading every event from") << device.device.c_str();
+        if(!masked){
+            // Anything could have changed while we weren't looking
+            syncTouches();
+            if(writer != nullptr){
+                writer->sync(device.fd);
+            }
+        }
+    }
+    bool isFloodFrame(){
+        return floodFrames.load()
+            && frameSize == 2
+            && frame[0].type == EV_ABS
+            && frame[0].code == ABS_DISTANCE;
     }
 };
 
@@ -0,0 +1,413 @@
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonArray>
+
+#include <cmath>
+
+#include "gestureengine.h"
+#include "devicesettings.h"
+#include "metricsapi.h"
+
+#ifdef DEBUG
+QDebug operator<<(QDebug debug, const Touch& touch){
+    QDebugStateSaver saver(debug);
+    debug.nospace() << touch.debugString().c_str();
+    return debug.maybeSpace();
+}
+QDebug operator<<(QDebug debug, Touch* touch){
+    QDebugStateSaver saver(debug);
+    debug.nospace() << touch->debugString().c_str();
+    return debug.maybeSpace();
+}
+#endif
+
+GestureRecognizer GestureRecognizer::fromJson(const QJsonObject& json, int edgeSize){
+    static const QMap<QString, int> types{
+        {"edge-swipe", EdgeSwipe},
+        {"swipe", Swipe},
+        {"tap", Tap},
+        {"long-press", LongPress},
+        {"pinch", Pinch},
+    };
+    static const QMap<QString, int> edges{
+        {"left", LeftEdge},
+        {"right", RightEdge},
+        {"top", TopEdge},
+        {"bottom", BottomEdge},
+    };
+    static const QMap<QString, int> directions{
+        {"right", Right},
+        {"left", Left},
+        {"up", Up},
+        {"down", Down},
+        {"in", In},
+        {"out", Out},
+    };
+    GestureRecognizer recognizer;
+    recognizer.action = json["action"].toString();
+    recognizer.type = types.value(json["type"].toString(), -1);
+    recognizer.edge = edges.value(json["edge"].toString(), NoEdge);
+    recognizer.direction = directions.value(json["direction"].toString(), NoDirection);
+    if(recognizer.type == EdgeSwipe){
+        // Always away from the edge
+        switch(recognizer.edge){
+            case LeftEdge: recognizer.direction = Right; break;
+            case RightEdge: recognizer.direction = Left; break;
+            case TopEdge: recognizer.direction = Down; break;
+            case BottomEdge: recognizer.direction = Up; break;
+            default: recognizer.type = -1;
+        }
+    }
+    recognizer.fingers = json["fingers"].toInt(recognizer.type == Pinch ? 2 : 1);
+    recognizer.edgeSize = json["edgeSize"].toInt(edgeSize);
+    recognizer.distance = json["distance"].toInt(GESTURE_LENGTH);
+    recognizer.flingVelocity = json["flingVelocity"].toDouble(GESTURE_FLING_VELOCITY);
+    recognizer.duration = json["duration"].toInt(recognizer.type == LongPress ? GESTURE_LONG_PRESS_DURATION : GESTURE_TAP_DURATION);
+    recognizer.movement = json["movement"].toInt(GESTURE_MOVEMENT);
+    recognizer.scale = json["scale"].toDouble(recognizer.direction == In ? GESTURE_PINCH_IN : GESTURE_PINCH_OUT);
+    if(recognizer.action.isEmpty() || recognizer.fingers < 1 || recognizer.fingers > TOUCH_MAX_SLOTS){
+        recognizer.type = -1;
+    }
+    if((recognizer.type == Swipe && recognizer.direction > Down) || (recognizer.type == Pinch && recognizer.direction < In)){
+        recognizer.type = -1;
+    }
+    return recognizer;
+}
+
+GestureEngine::GestureEngine(int slotCount, QObject* parent)
+: QObject(parent),
+  recognizers(),
+  tracker(slotCount),
+  activeSlots(0),
+  width(deviceSettings.getTouchWidth()),
+  height(deviceSettings.getTouchHeight()),
+  // Match the rotation applications are told to use for the touchscreen
+  invertX(deviceSettings.getDeviceType() == DeviceSettings::RM1),
+  invertY(deviceSettings.getDeviceType() != DeviceSettings::Unknown),
+  penActive(false),
+  disabledDirections(0),
+  alive(0),
+  m_claimed(false),
+  fingers(0),
+  maxFingers(0),
+  startTime(0),
+  lastTime(0),
+  frameTime(0),
+  startSpread(0),
+  spread(0),
+  movement(0) {
+    if(slotCount > TOUCH_MAX_SLOTS){
+        qDebug() << "Only tracking" << TOUCH_MAX_SLOTS << "of" << slotCount << "touch slots";
+    }
+    loadConfig(GESTURE_CONFIG_PATH);
+}
+void GestureEngine::loadConfig(const QString& path){
+    int edgeSize = deviceSettings.getDeviceType() == DeviceSettings::RM2 ? 40 : 20;
+    QJsonArray gestures;
+    QFile file(path);
+    if(file.open(QIODevice::ReadOnly)){
+        gestures = QJsonDocument::fromJson(file.readAll()).object()["gestures"].toArray();
+        if(gestures.isEmpty()){
+            qWarning() << "No gestures found in" << path;
+        }
+    }
+    if(gestures.isEmpty()){
+        for(auto edge : QStringList{"left", "right", "top", "bottom"}){
+            gestures.append(QJsonObject{
+                {"type", "edge-swipe"},
+                {"edge", edge},
+                {"action", edge},
+            });
+        }
+    }
+    recognizers.clear();
+    for(auto item : gestures){
+        auto recognizer = GestureRecognizer::fromJson(item.toObject(), edgeSize);
+        if(recognizer.type == -1){
+            qWarning() << "Ignoring invalid gesture" << item;
+            continue;
+        }
+        if(recognizers.size() == GESTURE_MAX_RECOGNIZERS){
+            qWarning() << "Only using the first" << GESTURE_MAX_RECOGNIZERS << "gestures";
+            break;
+        }
+        recognizers.append(recognizer);
+    }
+    qDebug() << "Loaded" << recognizers.size() << "gestures";
+}
+void GestureEngine::processFrame(const input_event* events, size_t count){
+    for(size_t i = 0; i < count; i++){
+        auto& event = events[i];
+        if(!tracker.handle(event)){
+            continue;
+        }
+        if(alive && penActive.load()){
+#ifdef DEBUG
+            qDebug() << "Gesture cancelled due to pen activity";
+#endif
+            alive = 0;
+        }
+        auto previous = activeSlots;
+        auto active = tracker.active();
+        activeSlots = active;
+        auto time = timestamp(event);
+        frameTime = MetricsAPI::timestamp(event);
+        if(!previous && active){
+            begin(time);
+        }else if(previous && !active){
+            release(time);
+        }else if(active && __builtin_popcount(previous) != __builtin_popcount(active)){
+            fingersChanged(time);
+        }else if(active){
+            update(time);
+        }
+    }
+}
+int GestureEngine::msecsUntilDeadline(){
+    qint64 deadline = -1;
+    for(auto mask = alive; mask; mask &= mask - 1){
+        auto& recognizer = recognizers[__builtin_ctz(mask)];
+        if(recognizer.type == GestureRecognizer::LongPress && recognizer.fingers == fingers){
+            auto time = startTime + recognizer.duration;
+            if(deadline == -1 || time < deadline){
+                deadline = time;
+            }
+        }
+    }
+    if(deadline == -1){
+        return -1;
+    }
+    return std::max(deadline - now(), (qint64)0);
+}
+void GestureEngine::checkDeadline(){
+    auto time = now();
+    for(auto mask = alive; mask; mask &= mask - 1){
+        auto index = __builtin_ctz(mask);
+        auto& recognizer = recognizers[index];
+        if(
+            recognizer.type == GestureRecognizer::LongPress
+            && recognizer.fingers == fingers
+            && time - startTime >= recognizer.duration
+        ){
+            recognize(index, (startTime + recognizer.duration) * 1000);
+            return;
+        }
+    }
+}
+QPointF GestureEngine::position(const Touch* touch){
+    return QPointF(
+        invertX ? width - touch->x : touch->x,
+        invertY ? height - touch->y : touch->y
+    );
+}
+void GestureEngine::measure(QPointF& centroid, double& spread){
+    QPointF total;
+    tracker.forEach(activeSlots, [this, &total](Touch* touch){
+        total += position(touch);
+    });
+    centroid = total / fingers;
+    double distance = 0;
+    tracker.forEach(activeSlots, [this, &distance, &centroid](Touch* touch){
+        auto offset = position(touch) - centroid;
+        distance += std::hypot(offset.x(), offset.y());
+    });
+    spread = distance / fingers;
+}
+void GestureEngine::begin(qint64 time){
+    fingers = maxFingers = __builtin_popcount(activeSlots);
+    startTime = lastTime = time;
+    m_claimed = false;
+    movement = 0;
+    velocity = QPointF();
+    measure(centroid, spread);
+    startCentroid = centroid;
+    startSpread = spread;
+    startPoint = position(tracker.touch(__builtin_ctz(activeSlots)));
+    alive = 0;
+    auto disabled = disabledDirections.load();
+    for(int i = 0; i < recognizers.size(); i++){
+        auto& recognizer = recognizers[i];
+        if(!wantsFingers(recognizer, fingers)){
+            continue;
+        }
+        if(recognizer.type == GestureRecognizer::EdgeSwipe || recognizer.type == GestureRecognizer::Swipe){
+            if(disabled & (1u << recognizer.direction)){
+                continue;
+            }
+        }
+        if(recognizer.type == GestureRecognizer::EdgeSwipe){
+            bool onEdge = false;
+            switch(recognizer.edge){
+                case GestureRecognizer::LeftEdge: onEdge = startPoint.x() <= recognizer.edgeSize; break;
+                case GestureRecognizer::RightEdge: onEdge = startPoint.x() >= width - recognizer.edgeSize; break;
+                case GestureRecognizer::TopEdge: onEdge = startPoint.y() <= recognizer.edgeSize; break;
+                case GestureRecognizer::BottomEdge: onEdge = startPoint.y() >= height - recognizer.edgeSize; break;
+            }
+            if(!onEdge){
+                continue;
+            }
+        }
+        alive |= 1u << i;
+    }
+#ifdef DEBUG
+    if(alive){
+        qDebug() << "Gesture started with" << fingers << "fingers at" << startPoint;
+    }
+#endif
+}
+void GestureEngine::fingersChanged(qint64 time){
+    fingers = __builtin_popcount(activeSlots);
+    lastTime = time;
+    if(fingers < maxFingers){
+        // Lifting, keep what was measured with every finger down for release
+        return;
+    }
+    maxFingers = fingers;
+    for(auto mask = alive; mask; mask &= mask - 1){
+        auto index = __builtin_ctz(mask);
+        if(!wantsFingers(recognizers[index], fingers)){
+            alive &= ~(1u << index);
+        }
+    }
+    // Measure from where all the fingers landed
+    measure(centroid, spread);
+    startCentroid = centroid;
+    startSpread = spread;
+    velocity = QPointF();
+}
+void GestureEngine::update(qint64 time){
+    if(!alive || fingers != maxFingers){
+        return;
+    }
+    QPointF current;
+    double currentSpread;
+    measure(current, currentSpread);
+    auto elapsed = time - lastTime;
+    if(elapsed > 0){
+        velocity = velocity * 0.5 + (current - centroid) / elapsed * 0.5;
+    }
+    centroid = current;
+    spread = currentSpread;
+    lastTime = time;
+    auto offset = centroid - startCentroid;
+    movement = std::max(movement, std::hypot(offset.x(), offset.y()));
+    for(auto mask = alive; mask; mask &= mask - 1){
+        auto index = __builtin_ctz(mask);
+        auto& recognizer = recognizers[index];
+        auto duration = time - startTime;
+        switch(recognizer.type){
+            case GestureRecognizer::EdgeSwipe:
+            case GestureRecognizer::Swipe:{
+                if(recognizer.fingers != fingers){
+                    break;
+                }
+                auto distance = along(offset, recognizer.direction);
+                if(distance <= -recognizer.distance){
+                    alive &= ~(1u << index);
+                }else if(
+                    recognizer.flingVelocity > 0
+                    && distance >= recognizer.distance
+                    && along(velocity, recognizer.direction) >= recognizer.flingVelocity
+                ){
+                    recognize(index, frameTime);
+                    return;
+                }
+            }break;
+            case GestureRecognizer::Pinch:{
+                if(recognizer.fingers != fingers || startSpread <= 0){
+                    break;
+                }
+                auto scale = spread / startSpread;
+                if(
+                    (recognizer.direction == GestureRecognizer::In && scale <= recognizer.scale)
+                    || (recognizer.direction == GestureRecognizer::Out && scale >= recognizer.scale)
+                ){
+                    recognize(index, frameTime);
+                    return;
+                }
+            }break;
+            case GestureRecognizer::Tap:
+                if(movement > recognizer.movement || duration > recognizer.duration){
+                    alive &= ~(1u << index);
+                }
+            break;
+            case GestureRecognizer::LongPress:
+                if(movement > recognizer.movement){
+                    alive &= ~(1u << index);
+                }else if(recognizer.fingers == fingers && duration >= recognizer.duration){
+                    recognize(index, frameTime);
+                    return;
+                }
+            break;
+        }
+    }
+}
+void GestureEngine::release(qint64 time){
+    auto offset = centroid - startCentroid;
+    auto duration = time - startTime;
+    for(auto mask = alive; mask; mask &= mask - 1){
+        auto index = __builtin_ctz(mask);
+        auto& recognizer = recognizers[index];
+        if(recognizer.fingers != maxFingers){
+            continue;
+        }
+        bool matched = false;
+        switch(recognizer.type){
+            case GestureRecognizer::EdgeSwipe:
+            case GestureRecognizer::Swipe:
+                // Must have gone far enough and still be heading the right way
+                matched = along(offset, recognizer.direction) >= recognizer.distance
+                    && along(velocity, recognizer.direction) >= 0;
+            break;
+            case GestureRecognizer::Pinch:
+                if(startSpread > 0){
+                    auto scale = spread / startSpread;
+                    matched = recognizer.direction == GestureRecognizer::In ? scale <= recognizer.scale : scale >= recognizer.scale;
+                }
+            break;
+            case GestureRecognizer::Tap:
+                matched = duration <= recognizer.duration && movement <= recognizer.movement;
+            break;
+            case GestureRecognizer::LongPress:
+                matched = duration >= recognizer.duration && movement <= recognizer.movement;
+            break;
+        }
+        if(matched){
+            recognize(index, frameTime);
+            break;
+        }
+    }
+    alive = 0;
+    m_claimed = false;
+    fingers = maxFingers = 0;
+}
+void GestureEngine::recognize(int index, qint64 timestamp){
+    auto& recognizer = recognizers[index];
+#ifdef DEBUG
+    qDebug() << "Gesture recognized" << recognizer.action;
+#endif
+    alive = 0;
+    m_claimed = activeSlots;
+    MetricsAPI::input("touch.gesture", timestamp);
+    emit recognized(recognizer.action, timestamp);
+}
+bool GestureEngine::wantsFingers(const GestureRecognizer& recognizer, int fingers){
+    // Fingers don't all land at once, so anything needing more could still match
+    return recognizer.fingers >= fingers;
+}
+double GestureEngine::along(const QPointF& vector, int direction){
+    switch(direction){
+        case GestureRecognizer::Right: return vector.x();
+        case GestureRecognizer::Left: return -vector.x();
+        case GestureRecognizer::Up: return -vector.y();
+        case GestureRecognizer::Down: return vector.y();
+        default: return 0;
+    }
+}
+qint64 GestureEngine::timestamp(const input_event& event){
+    return (qint64)event.time.tv_sec * 1000 + event.time.tv_usec / 1000;
+}
+qint64 GestureEngine::now(){
+    // Input events are timestamped with CLOCK_MONOTONIC
+    return MetricsAPI::now() / 1000;
+}
@@ -0,0 +1,132 @@
+#ifndef GESTUREENGINE_H
+#define GESTUREENGINE_H
+
+#include <QObject>
+#include <QDebug>
+#include <QVector>
+#include <QPointF>
+#include <QJsonObject>
+
+#include <atomic>
+#include <linux/input.h>
+
+#include "touchtracker.h"
+
+#define GESTURE_CONFIG_PATH "/opt/etc/gestures.json"
+#define GESTURE_LENGTH 30
+// Recognizers are tracked with a bitmask, any past this are ignored
+#define GESTURE_MAX_RECOGNIZERS 32
+// Units per millisecond, roughly 200mm/s on the rM1
+#define GESTURE_FLING_VELOCITY 1.0
+#define GESTURE_TAP_DURATION 200
+#define GESTURE_LONG_PRESS_DURATION 800
+#define GESTURE_MOVEMENT 20
+#define GESTURE_PINCH_IN 0.7
+#define GESTURE_PINCH_OUT 1.4
+
+#ifdef DEBUG
+QDebug operator<<(QDebug debug, const Touch& touch);
+QDebug operator<<(QDebug debug, Touch* touch);
+#endif
+Q_DECLARE_METATYPE(Touch)
+
+struct GestureRecognizer {
+    enum Type { EdgeSwipe, Swipe, Tap, LongPress, Pinch };
+    // Matches SystemAPI::SwipeDirection for the swipe directions
+    enum Direction { NoDirection, Right, Left, Up, Down, In, Out };
+    enum Edge { NoEdge, LeftEdge, RightEdge, TopEdge, BottomEdge };
+    QString action;
+    int type;
+    int fingers;
+    int edge;
+    int direction;
+    // Distances are in touchscreen units, times in milliseconds
+    int edgeSize;
+    int distance;
+    double flingVelocity;
+    int duration;
+    int movement;
+    double scale;
+
+    static GestureRecognizer fromJson(const QJsonObject& json, int edgeSize);
+};
+
+// Turns touchscreen frames into gestures.
+//
+// Runs on the input reactor's thread. Each frame only looks at the
+// recognizers that could still match, so the cost doesn't grow with how long
+// a finger has been down. Coordinates are flipped to match the screen before
+// anything looks at them.
+class GestureEngine : public QObject {
+    Q_OBJECT
+public:
+    GestureEngine(int slotCount, QObject* parent);
+    void loadConfig(const QString& path);
+    // Called from the input thread
+    void processFrame(const input_event* events, size_t count);
+    // Milliseconds until checkDeadline should be called, -1 for never
+    int msecsUntilDeadline();
+    void checkDeadline();
+    // True once a gesture has been recognised while fingers are still down,
+    // the rest of the touch shouldn't reach applications
+    bool claimed(){ return m_claimed; }
+    bool active(){ return activeSlots; }
+
+    // Safe to call from any thread
+    void setPenActive(bool active){ penActive.store(active); }
+    void setDirectionEnabled(int direction, bool enabled){
+        if(enabled){
+            disabledDirections.fetch_and(~(1u << direction));
+        }else{
+            disabledDirections.fetch_or(1u << direction);
+        }
+    }
+
+signals:
+    // timestamp is when the gesture completed in CLOCK_MONOTONIC microseconds,
+    // taken from the input event that completed it
+    void recognized(QString action, qint64 timestamp);
+
+private:
+    QVector<GestureRecognizer> recognizers;
+    TouchTracker tracker;
+    // Slots with a contact down as of the last frame
+    quint32 activeSlots;
+    int width;
+    int height;
+    bool invertX;
+    bool invertY;
+    std::atomic<bool> penActive;
+    std::atomic<quint32> disabledDirections;
+
+    // State for the current set of touches
+    quint32 alive;
+    bool m_claimed;
+    int fingers;
+    int maxFingers;
+    qint64 startTime;
+    qint64 lastTime;
+    // The frame being processed in microseconds
+    qint64 frameTime;
+    QPointF startPoint;
+    QPointF startCentroid;
+    double startSpread;
+    QPointF centroid;
+    double spread;
+    double movement;
+    QPointF velocity;
+
+    QPointF position(const Touch* touch);
+    void measure(QPointF& centroid, double& spread);
+    void begin(qint64 time);
+    void fingersChanged(qint64 time);
+    void update(qint64 time);
+    void release(qint64 time);
+    void recognize(int index, qint64 timestamp);
+    bool wantsFingers(const GestureRecognizer& recognizer, int fingers);
+    double along(const QPointF& vector, int direction);
+    static qint64 timestamp(const input_event& event);
+    static qint64 now();
+};
+
+#endif // GESTUREENGINE_H
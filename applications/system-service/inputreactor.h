@@ -0,0 +1,114 @@
+#ifndef INPUTREACTOR_H
+#define INPUTREACTOR_H
+
+#include <QThread>
+#include <QMutex>
+#include <QList>
+#include <QException>
+#include <QDebug>
+
+#include <cstring>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#define inputReactor InputReactor::singleton()
+// Most ready fds handled per epoll_wait()
+#define INPUT_REACTOR_MAX_EVENTS 8
+
+// Something the input reactor reads for.
+class InputSource {
+public:
+    virtual ~InputSource(){}
+    // Called on the reactor thread when fd is readable. Only read one batch,
+    // fds are level triggered so the reactor comes back if there is more.
+    // Returning false stops watching fd.
+    virtual bool readable(int fd) = 0;
+};
+
+// The one thread that reads every input device.
+//
+// Every source's fds share one epoll set, so a burst on one device is read in
+// a batch and then the others get a turn, without a thread per device.
+// Timeouts are timerfds watched like any other fd.
+class InputReactor : public QThread {
+    Q_OBJECT
+public:
+    static InputReactor* singleton(){
+        static InputReactor* instance;
+        if(instance != nullptr){
+            return instance;
+        }
+        instance = new InputReactor();
+        instance->start();
+        return instance;
+    }
+    InputReactor() : QThread(), watches(), mutex() {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if(epollFd == -1){
+            qDebug() << "Unable to create input reactor" << strerror(errno);
+            throw QException();
+        }
+    }
+    ~InputReactor(){
+        close(epollFd);
+        qDeleteAll(watches);
+    }
+    // Safe to call from any thread, a running epoll_wait() picks it up
+    bool addSource(int fd, InputSource* source){
+        auto watch = new Watch{fd, source};
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = watch;
+        QMutexLocker locker(&mutex);
+        if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1){
+            qDebug() << "Unable to watch input fd" << fd << strerror(errno);
+            delete watch;
+            return false;
+        }
+        watches.append(watch);
+        return true;
+    }
+
+protected:
+    void run(){
+        qDebug() << "Waiting for input...";
+        epoll_event events[INPUT_REACTOR_MAX_EVENTS];
+        while(true){
+            auto count = epoll_wait(epollFd, events, INPUT_REACTOR_MAX_EVENTS, -1);
+            if(count == -1){
+                if(errno == EINTR){
+                    continue;
+                }
+                qDebug() << "Failed to wait for input" << strerror(errno);
+                return;
+            }
+            for(int i = 0; i < count; i++){
+                auto watch = (Watch*)events[i].data.ptr;
+                if(!watch->source->readable(watch->fd)){
+                    removeWatch(watch);
+                }
+            }
+        }
+    }
+
+private:
+    struct Watch {
+        int fd;
+        InputSource* source;
+    };
+    int epollFd;
+    QList<Watch*> watches;
+    QMutex mutex;
+
+    // Only called from run(), so no later event in the batch can refer to it
+    void removeWatch(Watch* watch){
+        qDebug() << "No longer watching input fd" << watch->fd;
+        QMutexLocker locker(&mutex);
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, watch->fd, nullptr);
+        watches.removeOne(watch);
+        delete watch;
+    }
+};
+
+#endif // INPUTREACTOR_H
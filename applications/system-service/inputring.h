@@ -0,0 +1,54 @@
+#ifndef INPUTRING_H
+#define INPUTRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <linux/input.h>
+
+// Single producer, single consumer queue of input events.
+//
+// The producer only pushes whole SYN_REPORT frames so the consumer never sees
+// half a frame. Neither side takes a lock, one thread may push while another
+// pops. Size must be a power of two.
+template<size_t Size>
+class InputFrameRing {
+    static_assert(Size && !(Size & (Size - 1)), "Size must be a power of two");
+public:
+    InputFrameRing() : head(0), tail(0) {}
+    // Producer side, all or nothing
+    bool push(const input_event* events, size_t count){
+        auto write = head.load(std::memory_order_relaxed);
+        auto read = tail.load(std::memory_order_acquire);
+        if(count > Size - (write - read)){
+            return false;
+        }
+        for(size_t i = 0; i < count; i++){
+            buffer[(write + i) & (Size - 1)] = events[i];
+        }
+        head.store(write + count, std::memory_order_release);
+        return true;
+    }
+    // Consumer side
+    size_t pop(input_event* events, size_t max){
+        auto read = tail.load(std::memory_order_relaxed);
+        auto write = head.load(std::memory_order_acquire);
+        size_t count = write - read;
+        if(count > max){
+            count = max;
+        }
+        for(size_t i = 0; i < count; i++){
+            events[i] = buffer[(read + i) & (Size - 1)];
+        }
+        tail.store(read + count, std::memory_order_release);
+        return count;
+    }
+    bool isEmpty(){ return head.load(std::memory_order_acquire) == tail.load(std::memory_order_relaxed); }
+
+private:
+    input_event buffer[Size];
+    // Kept on separate cache lines so the threads don't fight over them
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+};
+
+#endif // INPUTRING_H
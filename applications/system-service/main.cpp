@@ -46,11 +46,11 @@ int main(int argc, char *argv[]){
     signal(SIGSEGV, sigHandler);
     signal(SIGTERM, sigHandler);
 
+    system("mkdir -p /run/oxide");
     dbusService;
     QTimer::singleShot(0, []{
         dbusService->startup();
     });
-    system("mkdir -p /run/oxide");
     system(("echo " + to_string(app.applicationPid()) + " > /run/oxide/oxide.pid").c_str());
     QObject::connect(&app, &QGuiApplication::aboutToQuit, []{
         remove("/run/oxide/oxide.pid");
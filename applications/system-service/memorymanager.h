@@ -0,0 +1,109 @@
+#ifndef MEMORYMANAGER_H
+#define MEMORYMANAGER_H
+
+#include <QObject>
+#include <QDebug>
+#include <QFile>
+#include <QTimer>
+#include <QSocketNotifier>
+#include <QElapsedTimer>
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define MEMORY_PRESSURE_PATH "/proc/pressure/memory"
+// Trigger when tasks stall on memory for 150ms within a one second window
+#define MEMORY_PRESSURE_TRIGGER "some 150000 1000000"
+#define MEMORY_POLL_INTERVAL 5000
+#define MEMORY_COOLDOWN 1000
+// Reclaim until at least this much of the total memory is available
+#define MEMORY_LOW_PERCENT 10
+
+// Reports when the system is running low on memory.
+//
+// Uses a PSI trigger when the kernel supports it and falls back to polling
+// MemAvailable otherwise. Deciding what to free is left to the listener.
+class MemoryManager : public QObject {
+    Q_OBJECT
+public:
+    MemoryManager(QObject* parent)
+    : QObject(parent),
+      fd(-1),
+      notifier(nullptr),
+      pollTimer(this),
+      cooldown() {
+        fd = open(MEMORY_PRESSURE_PATH, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if(fd != -1 && write(fd, MEMORY_PRESSURE_TRIGGER, strlen(MEMORY_PRESSURE_TRIGGER) + 1) < 0){
+            qDebug() << "Unable to register memory pressure trigger" << ::strerror(errno);
+            close(fd);
+            fd = -1;
+        }
+        if(fd != -1){
+            notifier = new QSocketNotifier(fd, QSocketNotifier::Exception, this);
+            connect(notifier, &QSocketNotifier::activated, this, &MemoryManager::check);
+            qDebug() << "Watching memory pressure";
+        }else{
+            connect(&pollTimer, &QTimer::timeout, this, [this]{
+                if(isLow()){
+                    check();
+                }
+            });
+            pollTimer.start(MEMORY_POLL_INTERVAL);
+            qDebug() << "Polling available memory";
+        }
+    }
+    ~MemoryManager(){
+        if(fd != -1){
+            close(fd);
+        }
+    }
+    bool isLow(){ return available() * 100 < total() * MEMORY_LOW_PERCENT; }
+    static qulonglong available(){ return meminfo("MemAvailable:"); }
+    static qulonglong total(){ return meminfo("MemTotal:"); }
+    // Resident memory of a process in bytes
+    static qulonglong resident(pid_t pid){
+        QFile file(QString("/proc/%1/statm").arg(pid));
+        if(!file.open(QIODevice::ReadOnly)){
+            return 0;
+        }
+        return file.readAll().split(' ').value(1).toULongLong() * sysconf(_SC_PAGESIZE);
+    }
+
+signals:
+    void memoryLow();
+
+private slots:
+    void check(){
+        // Give the last round of kills time to be reflected before acting again
+        if(cooldown.isValid() && !cooldown.hasExpired(MEMORY_COOLDOWN)){
+            return;
+        }
+        cooldown.start();
+        qDebug() << "Memory pressure, available:" << available();
+        emit memoryLow();
+    }
+
+private:
+    int fd;
+    QSocketNotifier* notifier;
+    QTimer pollTimer;
+    QElapsedTimer cooldown;
+
+    // Value in bytes for a /proc/meminfo field
+    static qulonglong meminfo(const char* field){
+        QFile file("/proc/meminfo");
+        if(!file.open(QIODevice::ReadOnly)){
+            return 0;
+        }
+        // procfs reports a size of 0, so atEnd() is true before anything is read
+        for(auto& line : file.readAll().split('\n')){
+            if(line.startsWith(field)){
+                return line.mid(strlen(field)).trimmed().split(' ').value(0).toULongLong() * 1024;
+            }
+        }
+        return 0;
+    }
+};
+
+#endif // MEMORYMANAGER_H
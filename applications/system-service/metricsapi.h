@@ -0,0 +1,460 @@
+#ifndef METRICSAPI_H
+#define METRICSAPI_H
+
+#include <QObject>
+#include <QDebug>
+#include <QMap>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include <QVariantMap>
+#include <QElapsedTimer>
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <time.h>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+
+#include "apibase.h"
+
+#define metricsAPI MetricsAPI::singleton()
+// Input stages are recorded as if they were phases of an application named this
+#define METRICS_INPUT "input"
+
+// Durations are bucketed with 8 sub-buckets per power of two, anything below
+// this many microseconds gets a bucket of its own
+#define METRICS_LINEAR_BUCKETS 16
+#define METRICS_SUB_BUCKET_BITS 3
+#define METRICS_BUCKETS (METRICS_LINEAR_BUCKETS + (64 - 4) * (1 << METRICS_SUB_BUCKET_BITS))
+// Input samples waiting for the main thread, enough for a second of every
+// device at full rate
+#define METRICS_QUEUE_SIZE 4096
+// How long input samples wait before the main thread is woken for them
+#define METRICS_DRAIN_INTERVAL 1000
+// The only place traces are written, tarnish runs as root
+#define METRICS_TRACE_DIR "/home/root/.cache/oxide/metrics"
+
+// Fixed memory latency histogram in microseconds, percentiles are accurate to
+// within 12.5% of the real value
+class LatencyHistogram {
+public:
+    LatencyHistogram() : counts(), m_count(0), m_total(0), m_min(0), m_max(0) {}
+    void record(qint64 usecs){
+        if(usecs < 0){
+            usecs = 0;
+        }
+        if(counts.isEmpty()){
+            counts.fill(0, METRICS_BUCKETS);
+        }
+        counts[bucket(usecs)]++;
+        if(!m_count || usecs < m_min){
+            m_min = usecs;
+        }
+        if(usecs > m_max){
+            m_max = usecs;
+        }
+        m_count++;
+        m_total += usecs;
+    }
+    void merge(const LatencyHistogram& other){
+        if(!other.m_count){
+            return;
+        }
+        if(counts.isEmpty()){
+            counts.fill(0, METRICS_BUCKETS);
+        }
+        for(int i = 0; i < METRICS_BUCKETS; i++){
+            counts[i] += other.counts[i];
+        }
+        if(!m_count || other.m_min < m_min){
+            m_min = other.m_min;
+        }
+        if(other.m_max > m_max){
+            m_max = other.m_max;
+        }
+        m_count += other.m_count;
+        m_total += other.m_total;
+    }
+    quint64 count() const{ return m_count; }
+    qint64 percentile(double percent) const{
+        if(!m_count){
+            return 0;
+        }
+        auto target = (quint64)std::ceil(m_count * percent / 100.0);
+        quint64 seen = 0;
+        for(int i = 0; i < METRICS_BUCKETS; i++){
+            seen += counts[i];
+            if(seen >= target && seen){
+                // Report the middle of the bucket, but never outside what was recorded
+                auto lower = lowerBound(i);
+                auto value = lower + (lowerBound(i + 1) - lower) / 2;
+                return qBound(m_min, value, m_max);
+            }
+        }
+        return m_max;
+    }
+    QVariantMap summary() const{
+        return QVariantMap{
+            {"count", m_count},
+            {"min", milliseconds(m_min)},
+            {"max", milliseconds(m_max)},
+            {"mean", m_count ? milliseconds(m_total) / m_count : 0.0},
+            {"p50", milliseconds(percentile(50))},
+            {"p90", milliseconds(percentile(90))},
+            {"p99", milliseconds(percentile(99))},
+        };
+    }
+    QVariantList buckets() const{
+        QVariantList result;
+        for(int i = 0; i < counts.size(); i++){
+            if(counts[i]){
+                result.append(QVariantMap{
+                    {"min", milliseconds(lowerBound(i))},
+                    {"max", milliseconds(lowerBound(i + 1))},
+                    {"count", counts[i]},
+                });
+            }
+        }
+        return result;
+    }
+
+private:
+    QVector<quint32> counts;
+    quint64 m_count;
+    qint64 m_total;
+    qint64 m_min;
+    qint64 m_max;
+
+    static double milliseconds(qint64 usecs){ return usecs / 1000.0; }
+    static int bucket(qint64 usecs){
+        if(usecs < METRICS_LINEAR_BUCKETS){
+            return usecs;
+        }
+        int exponent = 63 - __builtin_clzll(usecs);
+        int sub = (usecs >> (exponent - METRICS_SUB_BUCKET_BITS)) & ((1 << METRICS_SUB_BUCKET_BITS) - 1);
+        return METRICS_LINEAR_BUCKETS + ((exponent - 4) << METRICS_SUB_BUCKET_BITS) + sub;
+    }
+    static qint64 lowerBound(int index){
+        if(index < METRICS_LINEAR_BUCKETS){
+            return index;
+        }
+        index -= METRICS_LINEAR_BUCKETS;
+        int exponent = (index >> METRICS_SUB_BUCKET_BITS) + 4;
+        qint64 sub = index & ((1 << METRICS_SUB_BUCKET_BITS) - 1);
+        return ((1 << METRICS_SUB_BUCKET_BITS) + sub) << (exponent - METRICS_SUB_BUCKET_BITS);
+    }
+};
+
+// An input stage's latency, recorded off the main thread
+struct InputSample {
+    // A string literal
+    const char* stage;
+    // When the stage was reached, in CLOCK_MONOTONIC microseconds
+    qint64 time;
+    qint64 usecs;
+};
+
+// Bounded queue that any thread can push to without locking, only the main
+// thread pops. Every cell carries the position it's ready for, so producers
+// claim a cell with one compare and swap and publish it with one store.
+template<size_t Size>
+class InputSampleQueue {
+    static_assert(Size && !(Size & (Size - 1)), "Size must be a power of two");
+public:
+    InputSampleQueue() : head(0), tail(0) {
+        for(size_t i = 0; i < Size; i++){
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    // Returns false if the queue is full
+    bool push(const InputSample& sample){
+        auto position = head.load(std::memory_order_relaxed);
+        Cell* cell;
+        while(true){
+            cell = &cells[position & (Size - 1)];
+            auto sequence = cell->sequence.load(std::memory_order_acquire);
+            auto difference = (intptr_t)sequence - (intptr_t)position;
+            if(!difference){
+                if(head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)){
+                    break;
+                }
+            }else if(difference < 0){
+                return false;
+            }else{
+                position = head.load(std::memory_order_relaxed);
+            }
+        }
+        cell->sample = sample;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+    // Main thread only
+    bool pop(InputSample& sample){
+        auto& cell = cells[tail & (Size - 1)];
+        if(cell.sequence.load(std::memory_order_acquire) != tail + 1){
+            return false;
+        }
+        sample = cell.sample;
+        cell.sequence.store(tail + Size, std::memory_order_release);
+        tail++;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        InputSample sample;
+    };
+    Cell cells[Size];
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) size_t tail;
+};
+
+// Lifecycle timings for each application, and input latency.
+//
+// Phases are recorded whether or not anyone has requested the API, so a
+// client can connect after a slow switch and still see it. Input stages are
+// timed from the kernel's timestamp on the event that caused them, the input
+// devices are switched to CLOCK_MONOTONIC so it can be compared with now().
+//
+// Histograms and the trace are only touched on the main thread. Input stages
+// are queued without locking and folded in at most once a second, or as soon
+// as anything asks for them.
+class MetricsAPI : public APIBase {
+    Q_OBJECT
+    Q_CLASSINFO("Version", OXIDE_INTERFACE_VERSION)
+    Q_CLASSINFO("D-Bus Interface", OXIDE_METRICS_INTERFACE)
+    Q_PROPERTY(QStringList applications READ applications)
+    Q_PROPERTY(QStringList phases READ phases)
+    Q_PROPERTY(QString traceFile READ traceFile WRITE setTraceFile)
+public:
+    static MetricsAPI* singleton(MetricsAPI* self = nullptr){
+        static MetricsAPI* instance;
+        if(self != nullptr){
+            instance = self;
+        }
+        return instance;
+    }
+    MetricsAPI(QObject* parent) : APIBase(parent), histograms(), samples(), drainPending(false), dropped(0), drainTimer(this), trace(), traceStream() {
+        singleton(this);
+        drainTimer.setSingleShot(true);
+        drainTimer.setInterval(METRICS_DRAIN_INTERVAL);
+        connect(&drainTimer, &QTimer::timeout, this, &MetricsAPI::drain);
+    }
+    ~MetricsAPI(){
+        drain();
+        closeTrace();
+    }
+    void setEnabled(bool enabled){
+        qDebug() << "Metrics API" << enabled;
+    }
+
+    // Safe to call from any thread, but only cheap on the main one
+    void record(const QString& application, const QString& phase, qint64 usecs){
+        if(QThread::currentThread() != thread()){
+            auto time = now();
+            QMetaObject::invokeMethod(this, [=]{ record(application, phase, usecs, time); }, Qt::QueuedConnection);
+            return;
+        }
+        record(application, phase, usecs, now());
+    }
+    void record(const QString& application, const QString& phase, const QElapsedTimer& timer){
+        if(timer.isValid()){
+            record(application, phase, timer.nsecsElapsed() / 1000);
+        }
+    }
+
+    static void useMonotonicClock(int fd){
+        int clock = CLOCK_MONOTONIC;
+        if(ioctl(fd, EVIOCSCLOCKID, &clock) == -1){
+            qDebug() << "Unable to use monotonic timestamps for input" << strerror(errno);
+        }
+    }
+    // Microseconds on CLOCK_MONOTONIC
+    static qint64 now(){
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return (qint64)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+    }
+    static qint64 timestamp(const input_event& event){
+        return (qint64)event.time.tv_sec * 1000000 + event.time.tv_usec;
+    }
+    // Time from timestamp until now for an input stage, safe to call from any
+    // thread and before the API exists. stage has to be a string literal.
+    static void input(const char* stage, qint64 timestamp){
+        auto instance = singleton();
+        if(instance == nullptr){
+            return;
+        }
+        auto time = now();
+        if(!instance->samples.push(InputSample{stage, time, time - timestamp})){
+            instance->dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        if(!instance->drainPending.exchange(true)){
+            // Only once per drain, so a burst of input costs one wakeup
+            QMetaObject::invokeMethod(instance, "scheduleDrain", Qt::QueuedConnection);
+        }
+    }
+
+    QStringList applications(){
+        if(!hasPermission("metrics")){
+            return QStringList();
+        }
+        drain();
+        return histograms.keys();
+    }
+    QStringList phases(){
+        if(!hasPermission("metrics")){
+            return QStringList();
+        }
+        drain();
+        QStringList result;
+        for(auto application : histograms){
+            for(auto phase : application.keys()){
+                if(!result.contains(phase)){
+                    result.append(phase);
+                }
+            }
+        }
+        return result;
+    }
+
+    QString traceFile(){
+        if(!hasPermission("metrics")){
+            return "";
+        }
+        return trace.fileName();
+    }
+    // Append every recording to a file in METRICS_TRACE_DIR, an empty name
+    // stops. The full path is read back from traceFile.
+    void setTraceFile(QString name){
+        if(!hasPermission("metrics")){
+            return;
+        }
+        if(!name.isEmpty() && (name.contains('/') || name.startsWith('.'))){
+            qDebug() << "Refusing to trace metrics to" << name;
+            return;
+        }
+        drain();
+        closeTrace();
+        if(name.isEmpty()){
+            return;
+        }
+        QDir dir(METRICS_TRACE_DIR);
+        if(!dir.mkpath(".")){
+            qDebug() << "Unable to create" << dir.path();
+            return;
+        }
+        auto path = dir.filePath(name);
+        trace.setFileName(path);
+        if(!trace.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)){
+            qDebug() << "Unable to open trace file" << path << trace.errorString();
+            trace.setFileName("");
+            return;
+        }
+        traceStream.setDevice(&trace);
+        qDebug() << "Tracing metrics to" << path;
+    }
+
+    // Percentiles in milliseconds for each phase, or for every application
+    // combined when name is empty
+    Q_INVOKABLE QVariantMap summary(QString name){
+        if(!hasPermission("metrics")){
+            return QVariantMap();
+        }
+        auto phases = collect(name);
+        QVariantMap result;
+        for(auto phase : phases.keys()){
+            result.insert(phase, phases[phase].summary());
+        }
+        return result;
+    }
+    Q_INVOKABLE QVariantList histogram(QString name, QString phase){
+        if(!hasPermission("metrics")){
+            return QVariantList();
+        }
+        return collect(name).value(phase).buckets();
+    }
+    Q_INVOKABLE void reset(QString name){
+        if(!hasPermission("metrics")){
+            return;
+        }
+        drain();
+        if(name.isEmpty()){
+            histograms.clear();
+        }else{
+            histograms.remove(name);
+        }
+    }
+
+private slots:
+    void scheduleDrain(){
+        if(!drainTimer.isActive()){
+            drainTimer.start();
+        }
+    }
+    void drain(){
+        drainTimer.stop();
+        // Cleared first so a sample pushed while draining schedules another
+        drainPending.store(false);
+        InputSample sample;
+        while(samples.pop(sample)){
+            record(METRICS_INPUT, sample.stage, sample.usecs, sample.time);
+        }
+        auto lost = dropped.exchange(0, std::memory_order_relaxed);
+        if(lost){
+            qDebug() << "Metrics queue full, lost" << lost << "input samples";
+        }
+        if(trace.isOpen()){
+            traceStream.flush();
+        }
+    }
+
+private:
+    QMap<QString, QMap<QString, LatencyHistogram>> histograms;
+    InputSampleQueue<METRICS_QUEUE_SIZE> samples;
+    std::atomic<bool> drainPending;
+    std::atomic<quint64> dropped;
+    QTimer drainTimer;
+    QFile trace;
+    QTextStream traceStream;
+
+    // time is when it happened, in CLOCK_MONOTONIC microseconds
+    void record(const QString& application, const QString& phase, qint64 usecs, qint64 time){
+        histograms[application][phase].record(usecs);
+        if(trace.isOpen()){
+            traceStream << time << '\t' << application << '\t' << phase << '\t' << usecs << '\n';
+        }
+    }
+
+    void closeTrace(){
+        if(!trace.isOpen()){
+            return;
+        }
+        traceStream.flush();
+        traceStream.setDevice(nullptr);
+        trace.close();
+        trace.setFileName("");
+    }
+
+    QMap<QString, LatencyHistogram> collect(const QString& name){
+        drain();
+        if(!name.isEmpty()){
+            return histograms.value(name);
+        }
+        QMap<QString, LatencyHistogram> result;
+        for(auto application : histograms){
+            for(auto phase : application.keys()){
+                result[phase].merge(application[phase]);
+            }
+        }
+        return result;
+    }
+};
+
+#endif // METRICSAPI_H
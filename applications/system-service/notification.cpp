@@ -22,6 +22,8 @@ void Notification::display(){
         if(path.path() != "/"){
             resumeApp = appsAPI->getApplication(path);
             resumeApp->interruptApplication();
+            resumeApp->afterTransition([this, resumeApp]{ paintNotification(resumeApp); });
+            return;
         }
         paintNotification(resumeApp);
     });
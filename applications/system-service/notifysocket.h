@@ -0,0 +1,107 @@
+#ifndef NOTIFYSOCKET_H
+#define NOTIFYSOCKET_H
+
+#include <QObject>
+#include <QDebug>
+#include <QSocketNotifier>
+#include <QStringList>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstring>
+
+#define NOTIFY_SOCKET_PATH "/run/oxide/notify"
+#define NOTIFY_SOCKET_BUFFER 4096
+
+// sd_notify compatible readiness socket.
+//
+// Applications with the notify flag get NOTIFY_SOCKET in their environment and
+// send datagrams like "READY=1". The sender is taken from the kernel supplied
+// credentials instead of trusting a MAINPID field.
+class NotifySocket : public QObject {
+    Q_OBJECT
+public:
+    NotifySocket(QObject* parent) : QObject(parent), fd(-1), notifier(nullptr) {
+        fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if(fd == -1){
+            qWarning() << "Unable to create notify socket" << ::strerror(errno);
+            return;
+        }
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, NOTIFY_SOCKET_PATH, sizeof(address.sun_path) - 1);
+        unlink(NOTIFY_SOCKET_PATH);
+        int enable = 1;
+        if(
+            bind(fd, (struct sockaddr*)&address, sizeof(address))
+            || setsockopt(fd, SOL_SOCKET, SO_PASSCRED, &enable, sizeof(enable))
+        ){
+            qWarning() << "Unable to bind notify socket" << ::strerror(errno);
+            close(fd);
+            fd = -1;
+            return;
+        }
+        // Applications drop privileges before they notify
+        chmod(NOTIFY_SOCKET_PATH, 0777);
+        notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+        connect(notifier, &QSocketNotifier::activated, this, &NotifySocket::readMessages);
+    }
+    ~NotifySocket(){
+        if(fd != -1){
+            close(fd);
+            unlink(NOTIFY_SOCKET_PATH);
+        }
+    }
+    bool isValid(){ return fd != -1; }
+    QString path(){ return NOTIFY_SOCKET_PATH; }
+
+signals:
+    void notified(int pid, QStringList fields);
+
+private slots:
+    void readMessages(){
+        forever{
+            char buffer[NOTIFY_SOCKET_BUFFER];
+            union {
+                struct cmsghdr header;
+                char data[CMSG_SPACE(sizeof(struct ucred))];
+            } control;
+            struct iovec iov{
+                .iov_base = buffer,
+                .iov_len = sizeof(buffer) - 1,
+            };
+            struct msghdr message;
+            memset(&message, 0, sizeof(message));
+            message.msg_iov = &iov;
+            message.msg_iovlen = 1;
+            message.msg_control = &control;
+            message.msg_controllen = sizeof(control);
+            auto size = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+            if(size < 0){
+                break;
+            }
+            struct ucred* credentials = nullptr;
+            for(auto header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)){
+                if(header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_CREDENTIALS){
+                    credentials = (struct ucred*)CMSG_DATA(header);
+                }
+            }
+            if(credentials == nullptr){
+                qDebug() << "Ignoring notification without credentials";
+                continue;
+            }
+            buffer[size] = '\0';
+            emit notified(credentials->pid, QString::fromUtf8(buffer).split('\n', QString::SkipEmptyParts));
+        }
+    }
+
+private:
+    int fd;
+    QSocketNotifier* notifier;
+};
+
+#endif // NOTIFYSOCKET_H
@@ -0,0 +1,244 @@
+#ifndef PENRINGWRITER_H
+#define PENRINGWRITER_H
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QDebug>
+
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "penring.h"
+
+// Publishes decoded wacom frames into a PenRingLayout in a memfd.
+//
+// Frames are decoded and written on the input reactor's thread, clients are
+// added and removed from the main thread. Clients only ever get the memory
+// and their own eventfd, the writer never reads anything back from the
+// shared memory.
+class PenRingWriter {
+public:
+    PenRingWriter() : memory(-1), readOnly(-1), ring(nullptr), head(0), state(), pending(false), clients(), mutex() {
+        memset(&state, 0, sizeof(state));
+        memory = memfd_create("oxide-pen-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if(memory == -1){
+            qDebug() << "Unable to create pen ring" << strerror(errno);
+            return;
+        }
+        if(ftruncate(memory, sizeof(PenRingLayout)) == -1){
+            qDebug() << "Unable to size pen ring" << strerror(errno);
+            close(memory);
+            memory = -1;
+            return;
+        }
+        // A client that shrinks the memory would crash us the next time we write
+        fcntl(memory, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW);
+        // What clients get, the memory can't be mapped writable through it
+        readOnly = open(QString("/proc/self/fd/%1").arg(memory).toStdString().c_str(), O_RDONLY | O_CLOEXEC);
+        if(readOnly == -1){
+            qDebug() << "Unable to reopen pen ring read only" << strerror(errno);
+            close(memory);
+            memory = -1;
+            return;
+        }
+        auto address = mmap(nullptr, sizeof(PenRingLayout), PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+        if(address == MAP_FAILED){
+            qDebug() << "Unable to map pen ring" << strerror(errno);
+            close(readOnly);
+            close(memory);
+            readOnly = -1;
+            memory = -1;
+            return;
+        }
+        ring = (PenRingLayout*)address;
+#ifdef F_SEAL_FUTURE_WRITE
+        // Only the mapping above can write from now on. Older kernels refuse
+        // it, the read only descriptor is enough there.
+        fcntl(memory, F_ADD_SEALS, F_SEAL_FUTURE_WRITE);
+#endif
+        fcntl(memory, F_ADD_SEALS, F_SEAL_SEAL);
+        ring->magic = PEN_RING_MAGIC;
+        ring->version = PEN_RING_VERSION;
+        ring->size = PEN_RING_SIZE;
+        ring->slotSize = sizeof(PenRingSlot);
+    }
+    ~PenRingWriter(){
+        for(auto& client : clients){
+            close(client.second);
+        }
+        if(ring != nullptr){
+            munmap(ring, sizeof(PenRingLayout));
+        }
+        if(readOnly != -1){
+            close(readOnly);
+        }
+        if(memory != -1){
+            close(memory);
+        }
+    }
+    bool isValid(){ return ring != nullptr; }
+    // A read only descriptor for the memfd, to hand to clients
+    int fd(){ return readOnly; }
+    bool hasClients(){ return clientCount.load(); }
+    // Returns an eventfd that is written to whenever new frames are published,
+    // -1 on failure. It stays open until removeClients(name).
+    int addClient(const QString& name){
+        auto wakeup = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if(wakeup == -1){
+            qDebug() << "Unable to create pen ring wakeup" << strerror(errno);
+            return -1;
+        }
+        QMutexLocker locker(&mutex);
+        clients.append(qMakePair(name, wakeup));
+        clientCount.store(clients.size());
+        return wakeup;
+    }
+    void removeClients(const QString& name){
+        QMutexLocker locker(&mutex);
+        QMutableListIterator<QPair<QString, int>> i(clients);
+        while(i.hasNext()){
+            auto client = i.next();
+            if(client.first == name){
+                close(client.second);
+                i.remove();
+            }
+        }
+        clientCount.store(clients.size());
+    }
+
+    // Reads the axes and the pen's current state, called before frames are
+    // processed and again after the kernel drops events
+    void sync(int device){
+        if(ring == nullptr){
+            return;
+        }
+        input_absinfo info;
+        const QList<QPair<int, PenAxis*>> axes{
+            {ABS_X, &ring->x},
+            {ABS_Y, &ring->y},
+            {ABS_PRESSURE, &ring->pressure},
+            {ABS_DISTANCE, &ring->distance},
+            {ABS_TILT_X, &ring->tiltX},
+            {ABS_TILT_Y, &ring->tiltY},
+        };
+        for(auto& axis : axes){
+            if(ioctl(device, EVIOCGABS(axis.first), &info) == -1){
+                memset(&info, 0, sizeof(info));
+            }
+            axis.second->minimum = info.minimum;
+            axis.second->maximum = info.maximum;
+            axis.second->resolution = info.resolution;
+            setAxis(axis.first, info.value);
+        }
+        uint8_t keys[KEY_CNT / 8 + 1];
+        memset(keys, 0, sizeof(keys));
+        ioctl(device, EVIOCGKEY(sizeof(keys)), keys);
+        for(auto key : {BTN_TOOL_PEN, BTN_TOOL_RUBBER, BTN_TOUCH, BTN_STYLUS, BTN_STYLUS2}){
+            setKey(key, keys[key / 8] & (1 << (key % 8)));
+        }
+    }
+    // Called from the input reactor's thread with one whole frame
+    void processFrame(const input_event* events, size_t count){
+        if(ring == nullptr){
+            return;
+        }
+        for(size_t i = 0; i < count; i++){
+            auto& event = events[i];
+            switch(event.type){
+                case EV_ABS:
+                    setAxis(event.code, event.value);
+                break;
+                case EV_KEY:
+                    setKey(event.code, event.value);
+                break;
+                case EV_SYN:
+                    if(event.code == SYN_REPORT){
+                        state.timestamp = (qint64)event.time.tv_sec * 1000000 + event.time.tv_usec;
+                        publish();
+                    }
+                break;
+            }
+        }
+    }
+    // Wakes every client once for all the frames published since the last call
+    void wake(){
+        if(!pending){
+            return;
+        }
+        pending = false;
+        uint64_t value = 1;
+        QMutexLocker locker(&mutex);
+        for(auto& client : clients){
+            // Only fails if the counter would overflow, it's already awake then
+            ::write(client.second, &value, sizeof(value));
+        }
+    }
+
+private:
+    int memory;
+    int readOnly;
+    PenRingLayout* ring;
+    // Kept here so nothing a client writes to the memory can confuse us
+    uint32_t head;
+    PenFrame state;
+    bool pending;
+    QList<QPair<QString, int>> clients;
+    std::atomic<int> clientCount{0};
+    QMutex mutex;
+
+    void setAxis(int code, int value){
+        switch(code){
+            case ABS_X: state.x = value; break;
+            case ABS_Y: state.y = value; break;
+            case ABS_PRESSURE: state.pressure = value; break;
+            case ABS_DISTANCE: state.distance = value; break;
+            case ABS_TILT_X: state.tiltX = value; break;
+            case ABS_TILT_Y: state.tiltY = value; break;
+        }
+    }
+    void setKey(int code, int value){
+        uint16_t flag = 0;
+        switch(code){
+            case BTN_TOOL_PEN:
+            case BTN_TOOL_RUBBER:{
+                auto tool = code == BTN_TOOL_PEN ? PEN_TOOL_PEN : PEN_TOOL_RUBBER;
+                if(value){
+                    state.tool = tool;
+                }else if(state.tool == tool){
+                    state.tool = PEN_TOOL_NONE;
+                }
+                return;
+            }
+            case BTN_TOUCH: flag = PEN_FLAG_TOUCHING; break;
+            case BTN_STYLUS: flag = PEN_FLAG_BUTTON; break;
+            case BTN_STYLUS2: flag = PEN_FLAG_BUTTON2; break;
+            default: return;
+        }
+        if(value){
+            state.flags |= flag;
+        }else{
+            state.flags &= ~flag;
+        }
+    }
+    void publish(){
+        auto& slot = ring->entries[head % PEN_RING_SIZE];
+        slot.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.frame = state;
+        slot.sequence.store(head + 1, std::memory_order_release);
+        head++;
+        ring->head.store(head, std::memory_order_release);
+        pending = true;
+    }
+};
+
+#endif // PENRINGWRITER_H
@@ -0,0 +1,415 @@
+#ifndef SNAPSHOTSTORE_H
+#define SNAPSHOTSTORE_H
+
+#include <QByteArray>
+#include <QMap>
+#include <QMultiHash>
+#include <QVector>
+#include <QThread>
+#include <QDebug>
+#include <QRect>
+#include <QElapsedTimer>
+#include <QVariantMap>
+
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "screencodec.h"
+
+#define SNAPSHOT_TILE_WIDTH 117
+#define SNAPSHOT_TILE_HEIGHT 117
+#define SNAPSHOT_SPILL_TEMPLATE "/tmp/tarnish-snapshots-XXXXXX"
+
+#define snapshotStore SnapshotStore::singleton()
+
+struct SnapshotTile {
+    quint64 hash;
+    QByteArray data;
+    int references;
+    quint64 lastUsed;
+    bool spilled;
+    off_t offset;
+    int size;
+};
+
+struct ScreenSnapshot {
+    int width;
+    int height;
+    QVector<SnapshotTile*> tiles;
+};
+
+// Shared store for paused application screen captures.
+//
+// Frames are split into fixed size tiles and every unique tile is kept once,
+// compressed with ScreenCodec and reference counted. Snapshots are just a
+// table of tiles, so the blank margins, toolbars and white pages that most
+// paused applications have in common only take up memory once.
+//
+// Resident tiles are kept under a memory budget. When it is exceeded the
+// tiles that were least recently used are written to an unlinked spill file
+// in /tmp and mapped back in when a snapshot that uses them is recalled.
+// Space freed in the spill file is reused, and given back to the filesystem
+// right away, so the file never holds much more than the tiles still in it.
+class SnapshotStore {
+public:
+    static SnapshotStore* singleton(){
+        static SnapshotStore* instance;
+        if(instance == nullptr){
+            instance = new SnapshotStore();
+        }
+        return instance;
+    }
+    SnapshotStore()
+     : tiles(),
+       m_size(0),
+       m_budget(0),
+       m_clock(0),
+       m_spillFd(-1),
+       m_spillSize(0),
+       m_freeExtents(),
+       m_spilledTiles(0),
+       m_spilledBytes(0),
+       m_hits(0),
+       m_spills(0),
+       m_reloads(0),
+       m_reloadTime(0) {}
+    ~SnapshotStore(){
+        for(auto tile : tiles){
+            delete tile;
+        }
+        tiles.clear();
+        if(m_spillFd != -1){
+            close(m_spillFd);
+        }
+    }
+
+    ScreenSnapshot* save(const uint16_t* frameBuffer, int width, int height){
+        auto snapshot = new ScreenSnapshot{
+            .width = width,
+            .height = height,
+            .tiles = QVector<SnapshotTile*>(columns(width) * rows(height), nullptr),
+        };
+        QVector<QByteArray> encoded(snapshot->tiles.size());
+        QVector<quint64> hashes(snapshot->tiles.size());
+        parallelFor(snapshot->tiles.size(), [&](int index){
+            auto tile = readTile(frameBuffer, width, height, index);
+            encoded[index] = ScreenCodec::encode((const uint16_t*)tile.constData(), tile.size() / sizeof(uint16_t), 1);
+            hashes[index] = hash(encoded[index]);
+        });
+        auto stamp = ++m_clock;
+        for(int i = 0; i < snapshot->tiles.size(); i++){
+            snapshot->tiles[i] = acquire(hashes[i], encoded[i], stamp);
+        }
+        enforceBudget();
+        return snapshot;
+    }
+    bool recall(const ScreenSnapshot* snapshot, uint16_t* frameBuffer){
+        QElapsedTimer elapsed;
+        elapsed.start();
+        uchar* spill = nullptr;
+        bool spilled = std::any_of(snapshot->tiles.begin(), snapshot->tiles.end(), [](SnapshotTile* tile){
+            return tile->spilled;
+        });
+        // Unspilling tiles can shrink the file, but never below a tile that is
+        // still spilled
+        auto mappedSize = m_spillSize;
+        if(spilled){
+            spill = (uchar*)mmap(0, mappedSize, PROT_READ, MAP_SHARED, m_spillFd, 0);
+            if(spill == MAP_FAILED){
+                qDebug() << "Unable to map snapshot spill file" << ::strerror(errno);
+                return false;
+            }
+        }
+        QVector<bool> results(snapshot->tiles.size(), false);
+        parallelFor(snapshot->tiles.size(), [&](int index){
+            auto snapshotTile = snapshot->tiles[index];
+            auto data = snapshotTile->data;
+            if(snapshotTile->spilled){
+                data = QByteArray::fromRawData((const char*)spill + snapshotTile->offset, snapshotTile->size);
+            }
+            QByteArray tile;
+            tile.resize(tileSize(snapshot->width, snapshot->height, index) * sizeof(uint16_t));
+            auto pixels = (uint16_t*)tile.data();
+            if(ScreenCodec::decode(data, pixels, tile.size() / sizeof(uint16_t))){
+                writeTile(frameBuffer, snapshot->width, snapshot->height, index, pixels);
+                results[index] = true;
+            }
+        });
+        // Just on screen again, so the last to be spilled
+        auto stamp = ++m_clock;
+        for(auto tile : snapshot->tiles){
+            tile->lastUsed = stamp;
+            if(tile->spilled && tile->references > 1){
+                // Other snapshots still use it, keep it resident from now on
+                unspill(tile, spill);
+            }
+        }
+        if(spilled){
+            munmap(spill, mappedSize);
+            m_reloads++;
+            m_reloadTime += elapsed.elapsed();
+            enforceBudget();
+        }else{
+            m_hits++;
+        }
+        return !results.contains(false);
+    }
+    void release(ScreenSnapshot* snapshot){
+        for(auto tile : snapshot->tiles){
+            if(--tile->references){
+                continue;
+            }
+            tiles.remove(tile->hash, tile);
+            if(tile->spilled){
+                m_spilledTiles--;
+                m_spilledBytes -= tile->size;
+                freeSpill(tile->offset, tile->size);
+            }else{
+                m_size -= tile->data.size();
+            }
+            delete tile;
+        }
+        delete snapshot;
+    }
+    int tileCount(){ return tiles.size(); }
+    size_t size(){ return m_size; }
+    size_t budget(){ return m_budget; }
+    void setBudget(size_t budget){
+        m_budget = budget;
+        enforceBudget();
+    }
+    QVariantMap statistics(){
+        return QVariantMap {
+            {"tiles", tileCount()},
+            {"residentBytes", (qulonglong)m_size},
+            {"budget", (qulonglong)m_budget},
+            {"spilledTiles", m_spilledTiles},
+            {"spilledBytes", (qulonglong)m_spilledBytes},
+            {"spillFileBytes", (qulonglong)m_spillSize},
+            {"hits", m_hits},
+            {"spills", m_spills},
+            {"reloads", m_reloads},
+            {"reloadTime", m_reloadTime},
+        };
+    }
+
+private:
+    QMultiHash<quint64, SnapshotTile*> tiles;
+    size_t m_size;
+    size_t m_budget;
+    quint64 m_clock;
+    int m_spillFd;
+    off_t m_spillSize;
+    // Unused ranges of the spill file by offset, never adjacent to each other
+    // or to the end of the file
+    QMap<off_t, int> m_freeExtents;
+    int m_spilledTiles;
+    size_t m_spilledBytes;
+    qulonglong m_hits;
+    qulonglong m_spills;
+    qulonglong m_reloads;
+    qulonglong m_reloadTime;
+
+    static int columns(int width){ return (width + SNAPSHOT_TILE_WIDTH - 1) / SNAPSHOT_TILE_WIDTH; }
+    static int rows(int height){ return (height + SNAPSHOT_TILE_HEIGHT - 1) / SNAPSHOT_TILE_HEIGHT; }
+    static QRect tileRect(int width, int height, int index){
+        int x = index % columns(width) * SNAPSHOT_TILE_WIDTH;
+        int y = index / columns(width) * SNAPSHOT_TILE_HEIGHT;
+        return QRect(x, y, qMin(SNAPSHOT_TILE_WIDTH, width - x), qMin(SNAPSHOT_TILE_HEIGHT, height - y));
+    }
+    static size_t tileSize(int width, int height, int index){
+        auto rect = tileRect(width, height, index);
+        return rect.width() * rect.height();
+    }
+    static QByteArray readTile(const uint16_t* frameBuffer, int width, int height, int index){
+        auto rect = tileRect(width, height, index);
+        QByteArray tile;
+        tile.resize(rect.width() * rect.height() * sizeof(uint16_t));
+        auto pixels = (uint16_t*)tile.data();
+        for(int y = 0; y < rect.height(); y++){
+            memcpy(
+                pixels + y * rect.width(),
+                frameBuffer + (rect.y() + y) * width + rect.x(),
+                rect.width() * sizeof(uint16_t)
+            );
+        }
+        return tile;
+    }
+    static void writeTile(uint16_t* frameBuffer, int width, int height, int index, const uint16_t* pixels){
+        auto rect = tileRect(width, height, index);
+        for(int y = 0; y < rect.height(); y++){
+            memcpy(
+                frameBuffer + (rect.y() + y) * width + rect.x(),
+                pixels + y * rect.width(),
+                rect.width() * sizeof(uint16_t)
+            );
+        }
+    }
+    static quint64 hash(const QByteArray& data){
+        // FNV-1a
+        quint64 result = 14695981039346656037ULL;
+        auto bytes = (const uchar*)data.constData();
+        for(int i = 0; i < data.size(); i++){
+            result ^= bytes[i];
+            result *= 1099511628211ULL;
+        }
+        return result;
+    }
+    static void parallelFor(int count, std::function<void(int)> callback){
+        int threadCount = qBound(1, QThread::idealThreadCount(), SCREENCODEC_MAX_STRIPES);
+        QList<QThread*> threads;
+        for(int i = 1; i < threadCount; i++){
+            auto thread = QThread::create([callback, count, threadCount, i]{
+                for(int index = i; index < count; index += threadCount){
+                    callback(index);
+                }
+            });
+            thread->start();
+            threads.append(thread);
+        }
+        for(int index = 0; index < count; index += threadCount){
+            callback(index);
+        }
+        for(auto thread : threads){
+            thread->wait();
+            delete thread;
+        }
+    }
+    SnapshotTile* acquire(quint64 hash, const QByteArray& data, quint64 stamp){
+        // The codec is deterministic, so equal tiles always encode the same
+        for(auto tile : tiles.values(hash)){
+            if(tileData(tile) == data){
+                tile->references++;
+                tile->lastUsed = stamp;
+                return tile;
+            }
+        }
+        auto tile = new SnapshotTile{
+            .hash = hash,
+            .data = data,
+            .references = 1,
+            .lastUsed = stamp,
+            .spilled = false,
+            .offset = 0,
+            .size = data.size(),
+        };
+        tiles.insert(hash, tile);
+        m_size += data.size();
+        return tile;
+    }
+    QByteArray tileData(SnapshotTile* tile){
+        if(!tile->spilled){
+            return tile->data;
+        }
+        QByteArray data;
+        data.resize(tile->size);
+        if(pread(m_spillFd, data.data(), tile->size, tile->offset) != tile->size){
+            return QByteArray();
+        }
+        return data;
+    }
+    bool openSpillFile(){
+        if(m_spillFd != -1){
+            return true;
+        }
+        char path[] = SNAPSHOT_SPILL_TEMPLATE;
+        m_spillFd = mkstemp(path);
+        if(m_spillFd == -1){
+            qWarning() << "Unable to create snapshot spill file" << ::strerror(errno);
+            return false;
+        }
+        // Only this process needs it, remove it from the filesystem right away
+        unlink(path);
+        return true;
+    }
+    void enforceBudget(){
+        if(!m_budget || m_size <= m_budget || !openSpillFile()){
+            return;
+        }
+        QList<SnapshotTile*> resident;
+        for(auto tile : tiles){
+            if(!tile->spilled){
+                resident.append(tile);
+            }
+        }
+        std::sort(resident.begin(), resident.end(), [](SnapshotTile* a, SnapshotTile* b){
+            return a->lastUsed < b->lastUsed;
+        });
+        for(auto tile : resident){
+            if(m_size <= m_budget){
+                break;
+            }
+            auto offset = allocateSpill(tile->size);
+            if(pwrite(m_spillFd, tile->data.constData(), tile->size, offset) != tile->size){
+                qWarning() << "Unable to spill snapshot tile" << ::strerror(errno);
+                freeSpill(offset, tile->size);
+                break;
+            }
+            tile->offset = offset;
+            tile->spilled = true;
+            tile->data = QByteArray();
+            m_size -= tile->size;
+            m_spilledTiles++;
+            m_spilledBytes += tile->size;
+            m_spills++;
+        }
+        qDebug() << "Snapshots spilled to disk:" << m_spilledTiles << "tiles," << m_spilledBytes << "bytes in" << m_spillSize;
+    }
+    // First fit, the file only grows when nothing freed is big enough
+    off_t allocateSpill(int size){
+        for(auto i = m_freeExtents.begin(); i != m_freeExtents.end(); ++i){
+            if(i.value() < size){
+                continue;
+            }
+            auto offset = i.key();
+            auto remaining = i.value() - size;
+            m_freeExtents.erase(i);
+            if(remaining){
+                m_freeExtents.insert(offset + size, remaining);
+            }
+            return offset;
+        }
+        auto offset = m_spillSize;
+        m_spillSize += size;
+        return offset;
+    }
+    void freeSpill(off_t offset, int size){
+        auto next = m_freeExtents.lowerBound(offset);
+        if(next != m_freeExtents.end() && next.key() == offset + size){
+            size += next.value();
+            next = m_freeExtents.erase(next);
+        }
+        if(next != m_freeExtents.begin()){
+            auto previous = next - 1;
+            if(previous.key() + previous.value() == offset){
+                offset = previous.key();
+                size += previous.value();
+                m_freeExtents.erase(previous);
+            }
+        }
+        if(offset + size == m_spillSize){
+            ftruncate(m_spillFd, offset);
+            m_spillSize = offset;
+            return;
+        }
+        // /tmp is usually in memory, don't keep holding what was freed
+        fallocate(m_spillFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, size);
+        m_freeExtents.insert(offset, size);
+    }
+    // spill is the spill file mapped from the start
+    void unspill(SnapshotTile* tile, const uchar* spill){
+        tile->data = QByteArray((const char*)spill + tile->offset, tile->size);
+        tile->spilled = false;
+        m_size += tile->size;
+        m_spilledTiles--;
+        m_spilledBytes -= tile->size;
+        freeSpill(tile->offset, tile->size);
+    }
+};
+
+#endif // SNAPSHOTSTORE_H
@@ -5,19 +5,6 @@
 #include "notificationapi.h"
 #include "devicesettings.h"
 
-#ifdef DEBUG
-QDebug operator<<(QDebug debug, const Touch& touch){
-    QDebugStateSaver saver(debug);
-    debug.nospace() << touch.debugString().c_str();
-    return debug.maybeSpace();
-}
-QDebug operator<<(QDebug debug, Touch* touch){
-    QDebugStateSaver saver(debug);
-    debug.nospace() << touch->debugString().c_str();
-    return debug.maybeSpace();
-}
-#endif
-
 void SystemAPI::PrepareForSleep(bool suspending){
     auto device = deviceSettings.getDeviceType();
     if(suspending){
@@ -32,21 +19,25 @@ void SystemAPI::PrepareForSleep(bool suspending){
         }else{
             resumeApp = nullptr;
         }
-        if(QFile::exists("/usr/share/remarkable/sleeping.png")){
-            screenAPI->drawFullscreenImage("/usr/share/remarkable/sleeping.png");
-        }else{
-            screenAPI->drawFullscreenImage("/usr/share/remarkable/suspended.png");
-        }
-        buttonHandler->setEnabled(false);
-        if(device == DeviceSettings::DeviceType::RM2){
-            if(wifiAPI->state() != WifiAPI::State::Off){
-                wifiWasOn = true;
-                wifiAPI->disable();
+        // Sleep is held off by our delay inhibitor until the current
+        // application has finished pausing
+        appsAPI->afterTransitions([this, device]{
+            if(QFile::exists("/usr/share/remarkable/sleeping.png")){
+                screenAPI->drawFullscreenImage("/usr/share/remarkable/sleeping.png");
+            }else{
+                screenAPI->drawFullscreenImage("/usr/share/remarkable/suspended.png");
             }
-            system("rmmod brcmfmac");
-        }
-        releaseSleepInhibitors();
-        qDebug() << "Suspending...";
+            buttonHandler->setEnabled(false);
+            if(device == DeviceSettings::DeviceType::RM2){
+                if(wifiAPI->state() != WifiAPI::State::Off){
+                    wifiWasOn = true;
+                    wifiAPI->disable();
+                }
+                system("rmmod brcmfmac");
+            }
+            releaseSleepInhibitors();
+            qDebug() << "Suspending...";
+        });
     }else{
         inhibitSleep();
         qDebug() << "Resuming...";
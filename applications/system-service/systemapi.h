@@ -6,17 +6,17 @@
 #include <QMutableListIterator>
 #include <QTimer>
 #include <QMutex>
+#include <QDBusUnixFileDescriptor>
 
 #include "apibase.h"
 #include "buttonhandler.h"
 #include "application.h"
 #include "screenapi.h"
 #include "digitizerhandler.h"
+#include "gestureengine.h"
+#include "penringwriter.h"
 #include "login1_interface.h"
 
-
-#define GESTURE_LENGTH 30
-
 #define systemAPI SystemAPI::singleton()
 
 typedef org::freedesktop::login1::Manager Manager;
@@ -42,27 +42,6 @@ struct Inhibitor {
     bool released() { return fd == -1; }
 };
 
-struct Touch {
-    int slot = 0;
-    int id = -1;
-    int x = 0;
-    int y = 0;
-    bool active = false;
-    bool existing = false;
-    bool modified = true;
-    int pressure = 0;
-    int major = 0;
-    int minor = 0;
-    int orientation = 0;
-    string debugString() const{
-        return "<Touch " + to_string(id) + " (" + to_string(x) + ", " + to_string(y) + ") " + (active ? "pressed" : "released") + ">";
-    }
-};
-#ifdef DEBUG
-QDebug operator<<(QDebug debug, const Touch& touch);
-QDebug operator<<(QDebug debug, Touch* touch);
-#endif
-Q_DECLARE_METATYPE(Touch)
 Q_DECLARE_METATYPE(input_event)
 
 class SystemAPI : public APIBase {
@@ -88,7 +67,6 @@ public:
        sleepInhibitors(),
        powerOffInhibitors(),
        mutex(),
-       touches(),
        swipeStates() {
         for(short i = Right; i <= Down; i++){
             swipeStates[(SwipeDirection)i] = true;
@@ -124,11 +102,15 @@ public:
         // Ask Systemd to tell us nicely when we are about to suspend or resume
         inhibitSleep();
         inhibitPowerOff();
-        qRegisterMetaType<input_event>();
-        connect(touchHandler, &DigitizerHandler::activity, this, &SystemAPI::activity);
-        connect(touchHandler, &DigitizerHandler::inputEvent, this, &SystemAPI::touchEvent);
-        connect(wacomHandler, &DigitizerHandler::activity, this, &SystemAPI::activity);
-        connect(wacomHandler, &DigitizerHandler::inputEvent, this, &SystemAPI::penEvent);
+        gestures = new GestureEngine(touchHandler->slotCount(), this);
+        connect(gestures, &GestureEngine::recognized, this, &SystemAPI::gestureRecognized);
+        touchHandler->setGestureEngine(gestures);
+        connect(touchHandler, &DigitizerHandler::framesAvailable, this, &SystemAPI::touchEvents);
+        connect(wacomHandler, &DigitizerHandler::framesAvailable, this, &SystemAPI::penEvents);
+        penRingWriter = new PenRingWriter();
+        if(penRingWriter->isValid()){
+            wacomHandler->setPenRing(penRingWriter);
+        }
         qDebug() << "System API ready to use";
     }
     ~SystemAPI(){
@@ -141,6 +123,8 @@ public:
             i.remove();
         }
         delete systemd;
+        wacomHandler->setPenRing(nullptr);
+        delete penRingWriter;
     }
     void setEnabled(bool enabled){
         qDebug() << "System API" << enabled;
@@ -188,6 +172,7 @@ public:
                 return;
         }
         swipeStates[direction] = enabled;
+        gestures->setDirectionEnabled(direction, enabled);
     }
     Q_INVOKABLE bool getSwipeEnabled(int direction){
         if(!hasPermission("system")){
@@ -211,6 +196,38 @@ public:
         toggleSwipeEnabled((SwipeDirection)direction);
     }
     void toggleSwipeEnabled(SwipeDirection direction){ setSwipeEnabled(direction, !getSwipeEnabled(direction)); }
+    // Closes the pen ring wakeups handed to a D-Bus name that left the bus
+    void releasePenRing(const QString& name){
+        penRingWriter->removeClients(name);
+        wacomHandler->updateMask();
+    }
+    // Called through a queued connection from the button thread
+    void buttonHeld(Qt::Key key, qint64 timestamp){
+        MetricsAPI::input("button.dispatch", timestamp);
+        QString name;
+        switch(key){
+            case Qt::Key_Left:
+                emit leftAction();
+                name = "left";
+            break;
+            case Qt::Key_Home:
+                emit homeAction();
+                name = "home";
+            break;
+            case Qt::Key_Right:
+                emit rightAction();
+                name = "right";
+            break;
+            case Qt::Key_PowerOff:
+                emit powerAction();
+                name = "power";
+            break;
+            default:
+                return;
+        }
+        emit keyHeld(name, timestamp);
+        MetricsAPI::input("button.action", timestamp);
+    }
 public slots:
     void suspend(){
         if(sleepInhibited()){
@@ -270,6 +287,22 @@ public slots:
         }
     }
     void toggleSwipes();
+    // Memory to read with PenRingReader, wakeup is written to whenever frames
+    // are added
+    QDBusUnixFileDescriptor penRing(QDBusUnixFileDescriptor& wakeup){
+        if(!calledFromDBus() || !hasPermission("system") || !penRingWriter->isValid()){
+            return QDBusUnixFileDescriptor();
+        }
+        auto fd = penRingWriter->addClient(message().service());
+        if(fd == -1){
+            return QDBusUnixFileDescriptor();
+        }
+        // The kernel has to send every pen event again
+        wacomHandler->updateMask();
+        // Both are duplicated for the reply, the wakeup stays open here
+        wakeup = QDBusUnixFileDescriptor(fd);
+        return QDBusUnixFileDescriptor(penRingWriter->fd());
+    }
 signals:
     void leftAction();
     void homeAction();
@@ -282,123 +315,61 @@ signals:
     void autoSleepChanged(int);
     void deviceSuspending();
     void deviceResuming();
+    // timestamp is from the input event that completed it, in CLOCK_MONOTONIC
+    // microseconds
+    void gesture(QString action, qint64 timestamp);
+    // timestamp is when the key had been down long enough, in CLOCK_MONOTONIC
+    // microseconds
+    void keyHeld(QString key, qint64 timestamp);
 
 private slots:
     void PrepareForSleep(bool suspending);
     void timeout();
-    void touchEvent(const input_event& event){
-        switch(event.type){
-            case EV_SYN:
-                switch(event.code){
-                    case SYN_REPORT:
-                        // Always mark the current slot as modified
-                        auto touch = getEvent(currentSlot);
-                        touch->modified = true;
-                        QList<Touch*> released;
-                        QList<Touch*> pressed;
-                        QList<Touch*> moved;
-                        for(auto touch : touches.values()){
-                            if(touch->id == -1){
-                                touch->active = false;
-                                released.append(touch);
-                            }else if(!touch->active){
-                                released.append(touch);
-                            }else if(!touch->existing){
-                                pressed.append(touch);
-                            }else if(touch->modified){
-                                moved.append(touch);
-                            }
-                        }
-                        if(!penActive){
-                            if(pressed.length()){
-                                touchDown(pressed);
-                            }
-                            if(moved.length()){
-                                touchMove(moved);
-                            }
-                            if(released.length()){
-                                touchUp(released);
-                            }
-                        }else if(swipeDirection != None){
-#ifdef DEBUG
-        qDebug() << "Swiping cancelled due to pen activity";
-#endif
-                            swipeDirection = None;
-                        }
-                        // Cleanup released touches
-                        for(auto touch : released){
-                            if(!touch->active){
-                                touches.remove(touch->slot);
-                                delete touch;
-                            }
-                        }
-                        // Setup touches for next event set
-                        for(auto touch : touches.values()){
-                            touch->modified = false;
-                            touch->existing = true;
-                        }
-                    break;
-                }
-            break;
-            case EV_ABS:
-                if(currentSlot == -1 && event.code != ABS_MT_SLOT){
-                    return;
-                }
-                switch(event.code){
-                    case ABS_MT_SLOT:{
-                        currentSlot = event.value;
-                        auto touch = getEvent(currentSlot);
-                        touch->modified = true;
-                    }break;
-                    case ABS_MT_TRACKING_ID:{
-                        auto touch = getEvent(currentSlot);
-                        if(event.value == -1){
-                            touch->active = false;
-                            currentSlot = 0;
-                        }else{
-                            touch->active = true;
-                            touch->id = event.value;
-                        }
-                    }break;
-                    case ABS_MT_POSITION_X:{
-                        auto touch = getEvent(currentSlot);
-                        touch->x = event.value;
-                    }break;
-                    case ABS_MT_POSITION_Y:{
-                        auto touch = getEvent(currentSlot);
-                        touch->y = event.value;
-                    }break;
-                    case ABS_MT_PRESSURE:{
-                        auto touch = getEvent(currentSlot);
-                        touch->pressure = event.value;
-                    }break;
-                    case ABS_MT_TOUCH_MAJOR:{
-                        auto touch = getEvent(currentSlot);
-                        touch->major = event.value;
-                    }break;
-                    case ABS_MT_TOUCH_MINOR:{
-                        auto touch = getEvent(currentSlot);
-                        touch->minor = event.value;
-                    }break;
-                    case ABS_MT_ORIENTATION:{
-                        auto touch = getEvent(currentSlot);
-                        touch->orientation = event.value;
-                    }break;
-                }
-            break;
+    void touchEvents(){
+        input_event events[DIGITIZER_READ_SIZE];
+        // Gestures are picked out on the input thread, this is only activity
+        while(touchHandler->readEvents(events, DIGITIZER_READ_SIZE)){}
+        activity();
+    }
+    void penEvents(){
+        input_event events[DIGITIZER_READ_SIZE];
+        size_t count;
+        while((count = wacomHandler->readEvents(events, DIGITIZER_READ_SIZE))){
+            for(size_t i = 0; i < count; i++){
+                penEvent(events[i]);
+            }
         }
+        activity();
     }
+    void gestureRecognized(QString action, qint64 timestamp){
+        MetricsAPI::input("touch.dispatch", timestamp);
+        if(action == "left"){
+            emit leftAction();
+        }else if(action == "right"){
+            emit rightAction();
+        }else if(action == "top"){
+            emit topAction();
+        }else if(action == "bottom"){
+            emit bottomAction();
+        }else if(action == "home"){
+            emit homeAction();
+        }else if(action == "power"){
+            emit powerAction();
+        }
+        emit gesture(action, timestamp);
+        MetricsAPI::input("touch.action", timestamp);
+    }
+
+private:
     void penEvent(const input_event& event){
         if(event.type != EV_KEY || event.code != BTN_TOOL_PEN){
             return;
         }
-        penActive = event.value;
+        gestures->setPenActive(event.value);
 #ifdef DEBUG
-        qDebug() << "Pen state: " << (penActive ? "Active" : "Inactive");
+        qDebug() << "Pen state: " << (event.value ? "Active" : "Inactive");
 #endif
     }
-
-private:
     Manager* systemd;
     QList<Inhibitor> inhibitors;
     Application* resumeApp;
@@ -407,14 +378,10 @@ private:
     QStringList sleepInhibitors;
     QStringList powerOffInhibitors;
     QMutex mutex;
-    QMap<int, Touch*> touches;
-    int currentSlot = 0;
+    GestureEngine* gestures;
+    PenRingWriter* penRingWriter;
     int m_autoSleep;
     bool wifiWasOn = false;
-    bool penActive = false;
-    int swipeDirection = None;
-    QPoint location;
-    QPoint startLocation;
     QMap<SwipeDirection, bool> swipeStates;
 
     void inhibitSleep(){
@@ -451,233 +418,6 @@ private:
     void rguard(bool install){
         QProcess::execute("/opt/bin/rguard", QStringList() << (install ? "-1" : "-0"));
     }
-    Touch* getEvent(int slot){
-        if(slot == -1){
-            return nullptr;
-        }
-        if(!touches.contains(slot)){
-            touches.insert(slot, new Touch{
-                .slot = slot
-            });
-        }
-        return touches.value(slot);
-    }
-    int getCurrentFingers(){
-        return std::count_if(touches.begin(), touches.end(), [](Touch* touch){
-            return touch->active;
-        });
-    }
-
-    void touchDown(QList<Touch*> touches){
-        if(penActive){
-            return;
-        }
-#ifdef DEBUG
-        qDebug() << "DOWN" << touches;
-#endif
-        if(getCurrentFingers() != 1){
-            return;
-        }
-        auto touch = touches.first();
-        if(swipeDirection != None){
-            return;
-        }
-        int offset = 20;
-        if(deviceSettings.getDeviceType() == DeviceSettings::RM2){
-            offset = 40;
-        }
-        if(touch->y <= offset){
-            swipeDirection = Up;
-        }else if(touch->y > (deviceSettings.getTouchHeight() - offset)){
-            swipeDirection = Down;
-        }else if(touch->x <= offset){
-            if(deviceSettings.getDeviceType() == DeviceSettings::RM2){
-                swipeDirection = Right;
-            }else{
-                swipeDirection = Left;
-            }
-        }else if(touch->x > (deviceSettings.getTouchWidth() - offset)){
-            if(deviceSettings.getDeviceType() == DeviceSettings::RM2){
-                swipeDirection = Left;
-            }else{
-                swipeDirection = Right;
-            }
-        }else{
-            return;
-        }
-        //touchHandler->grab();
-#ifdef DEBUG
-            qDebug() << "Swipe started" << swipeDirection;
-#endif
-        startLocation = location = QPoint(touch->x, touch->y);
-    }
-    void touchUp(QList<Touch*> touches){
-#ifdef DEBUG
-        qDebug() << "UP" << touches;
-#endif
-        if(swipeDirection == None){
-#ifdef DEBUG
-            qDebug() << "Not swiping";
-#endif
-            if(touchHandler->grabbed()){
-                for(auto touch : touches){
-                    writeTouchUp(touch);
-                }
-                touchHandler->ungrab();
-            }
-            return;
-        }
-        if(getCurrentFingers()){
-#ifdef DEBUG
-            qDebug() << "Still swiping";
-#endif
-            if(touchHandler->grabbed()){
-                for(auto touch : touches){
-                    writeTouchUp(touch);
-                }
-            }
-            return;
-        }
-        if(touches.length() > 1){
-#ifdef DEBUG
-            qDebug() << "Too many fingers";
-#endif
-            if(touchHandler->grabbed()){
-                for(auto touch : touches){
-                    writeTouchUp(touch);
-                }
-                touchHandler->ungrab();
-            }
-            swipeDirection = None;
-            return;
-        }
-        auto touch = touches.first();
-        if(swipeDirection == Up){
-            if(!swipeStates[Up] || touch->y < location.y() || touch->y - startLocation.y() < GESTURE_LENGTH){
-                // Must end swiping up and having gone far enough
-                cancelSwipe(touch);
-                return;
-            }
-            emit bottomAction();
-        }else if(swipeDirection == Down){
-            if(!swipeStates[Down] || touch->y > location.y() || startLocation.y() - touch->y < GESTURE_LENGTH){
-                // Must end swiping down and having gone far enough
-                cancelSwipe(touch);
-                return;
-            }
-            emit topAction();
-        }else if(swipeDirection == Right || swipeDirection == Left){
-            auto isRM2 = deviceSettings.getDeviceType() == DeviceSettings::RM2;
-            auto invalidLeft = !swipeStates[Left] || touch->x < location.x() || touch->x - startLocation.x() < GESTURE_LENGTH;
-            auto invalidRight = !swipeStates[Right] || touch->x > location.x() || startLocation.x() - touch->x < GESTURE_LENGTH;
-            if(swipeDirection == Right && (isRM2 ? invalidLeft : invalidRight)){
-                // Must end swiping right and having gone far enough
-                cancelSwipe(touch);
-                return;
-            }else if(swipeDirection == Left && (isRM2 ? invalidRight : invalidLeft)){
-                // Must end swiping left and having gone far enough
-                cancelSwipe(touch);
-                return;
-            }
-            if(swipeDirection == Left){
-                emit rightAction();
-
-            }else{
-                emit leftAction();
-            }
-        }
-        swipeDirection = None;
-        touchHandler->ungrab();
-        touch->x = -1;
-        touch->y = -1;
-        writeTouchUp(touch);
-#ifdef DEBUG
-            qDebug() << "Swipe direction" << swipeDirection;
-#endif
-    }
-    void touchMove(QList<Touch*> touches){
-#ifdef DEBUG
-        qDebug() << "MOVE" << touches;
-#endif
-        if(swipeDirection == None){
-            if(touchHandler->grabbed()){
-                for(auto touch : touches){
-                    writeTouchMove(touch);
-                }
-                touchHandler->ungrab();
-            }
-            return;
-        }
-        if(touches.length() > 1){
-#ifdef DEBUG
-            qDebug() << "Too many fingers";
-#endif
-            if(touchHandler->grabbed()){
-                for(auto touch : touches){
-                    writeTouchMove(touch);
-                }
-                touchHandler->ungrab();
-            }
-            swipeDirection = None;
-            return;
-        }
-        auto touch = touches.first();
-        if(touch->y > location.y()){
-            location = QPoint(touch->x, touch->y);
-        }
-    }
-    void cancelSwipe(Touch* touch){
-#ifdef DEBUG
-        qDebug() << "Swipe Cancelled";
-#endif
-        swipeDirection = None;
-        touchHandler->ungrab();
-        writeTouchUp(touch);
-    }
-    void writeTouchUp(Touch* touch){
-        bool grabbed = touchHandler->grabbed();
-        if(grabbed){
-            touchHandler->ungrab();
-        }
-        writeTouchMove(touch);
-#ifdef DEBUG
-        qDebug() << "Write touch up" << touch;
-#endif
-        int size = sizeof(input_event) * 3;
-        input_event* events = (input_event*)malloc(size);
-        events[0] = DigitizerHandler::createEvent(EV_ABS, ABS_MT_SLOT, touch->slot);
-        events[1] = DigitizerHandler::createEvent(EV_ABS, ABS_MT_TRACKING_ID, -1);
-        events[2] = DigitizerHandler::createEvent(EV_SYN, 0, 0);
-        touchHandler->write(events, size);
-        free(events);
-        if(grabbed){
-            touchHandler->grab();
-        }
-    }
-    void writeTouchMove(Touch* touch){
-        bool grabbed = touchHandler->grabbed();
-        if(grabbed){
-            touchHandler->ungrab();
-        }
-#ifdef DEBUG
-        qDebug() << "Write touch move" << touch;
-#endif
-        int size = sizeof(input_event) * 8;
-        input_event* events = (input_event*)malloc(size);
-        events[2] = DigitizerHandler::createEvent(EV_ABS, ABS_MT_SLOT, touch->slot);
-        events[2] = DigitizerHandler::createEvent(EV_ABS, ABS_MT_POSITION_X, touch->x);
-        events[2] = DigitizerHandler::createEvent(EV_ABS, ABS_MT_POSITION_Y, touch->y);
-        events[2] = DigitizerHandler::createEvent(EV_ABS, ABS_MT_PRESSURE, touch->pressure);
-        events[2] = DigitizerHandler::createEvent(EV_ABS, ABS_MT_TOUCH_MAJOR, touch->major);
-        events[2] = DigitizerHandler::createEvent(EV_ABS, ABS_MT_TOUCH_MINOR, touch->minor);
-        events[2] = DigitizerHandler::createEvent(EV_ABS, ABS_MT_ORIENTATION, touch->orientation);
-        events[2] = DigitizerHandler::createEvent(EV_SYN, 0, 0);
-        touchHandler->write(events, size);
-        free(events);
-        if(grabbed){
-            touchHandler->grab();
-        }
-    }
     void fn(){
         auto n = 512 * 8;
         auto num_inst = 4;
@@ -14,6 +14,7 @@ SOURCES += \
     bss.cpp \
     buttonhandler.cpp \
     event_device.cpp \
+    gestureengine.cpp \
     network.cpp \
     notification.cpp \
     screenshot.cpp \
@@ -37,6 +38,10 @@ service.files = ../../assets/etc/systemd/system/tarnish.service
 service.path = /etc/systemd/system/
 INSTALLS += service
 
+gestures.files = ../../assets/etc/gestures.json
+gestures.path = /opt/etc/
+INSTALLS += gestures
+
 applications.files = ../../assets/opt/usr/share/applications/*
 applications.path = /opt/usr/share/applications/
 INSTALLS += applications
@@ -55,26 +60,40 @@ HEADERS += \
     appsapi.h \
     bss.h \
     buttonhandler.h \
+    cgroup.h \
     dbusservice.h \
     dbussettings.h \
     digitizerhandler.h \
     event_device.h \
     fifohandler.h \
+    gestureengine.h \
+    inputreactor.h \
+    inputring.h \
+    memorymanager.h \
+    metricsapi.h \
     mxcfb.h \
     network.h \
     notification.h \
     notificationapi.h \
+    notifysocket.h \
+    penringwriter.h \
     powerapi.h \
     screenapi.h \
+    snapshotstore.h \
     screenshot.h \
     supplicant.h \
     sysobject.h \
     systemapi.h \
+    uinputdevice.h \
     wifiapi.h \
     wlan.h \
     wpa_supplicant.h \
     ../../shared/devicesettings.h \
-    ../../shared/signalhandler.h
+    ../../shared/penring.h \
+    ../../shared/screencodec.h \
+    ../../shared/signalhandler.h \
+    ../../shared/touchtracker.h \
+    ../../shared/zygote.h
 
 linux-oe-g++ {
     LIBS += -lqsgepaper
@@ -86,6 +105,7 @@ linux-oe-g++ {
 QMAKE_POST_LINK += sh $$_PRO_FILE_PWD_/generate_xml.sh
 
 DISTFILES += \
+    ../../assets/etc/gestures.json \
     ../../assets/opt/usr/share/applications/codes.eeems.anxiety.oxide \
     ../../assets/opt/usr/share/applications/codes.eeems.corrupt.oxide \
     fi.w1.wpa_supplicant1.xml \
@@ -0,0 +1,146 @@
+#ifndef UINPUTDEVICE_H
+#define UINPUTDEVICE_H
+
+#include <QDir>
+#include <QFileInfo>
+#include <QThread>
+#include <QDebug>
+
+#include <cstring>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// A uinput copy of a real input device.
+//
+// tarnish keeps the real device grabbed and writes what applications should
+// see here instead, so nothing has to be ungrabbed to let events through.
+class UInputDevice {
+public:
+    // Returns nullptr if the copy couldn't be created
+    static UInputDevice* clone(int source){
+        auto device = new UInputDevice();
+        if(!device->create(source)){
+            delete device;
+            return nullptr;
+        }
+        return device;
+    }
+    ~UInputDevice(){
+        if(fd != -1){
+            ioctl(fd, UI_DEV_DESTROY);
+            close(fd);
+        }
+    }
+    // The event device applications open
+    const QString& path(){ return m_path; }
+    bool write(const input_event* events, size_t count){
+        auto size = count * sizeof(input_event);
+        return ::write(fd, events, size) == (ssize_t)size;
+    }
+    bool write(ushort type, ushort code, int value){
+        input_event event;
+        memset(&event, 0, sizeof(event));
+        event.type = type;
+        event.code = code;
+        event.value = value;
+        return write(&event, 1);
+    }
+
+private:
+    int fd;
+    QString m_path;
+
+    UInputDevice() : fd(-1), m_path() {}
+    bool create(int source){
+        char name[UINPUT_MAX_NAME_SIZE];
+        memset(name, 0, sizeof(name));
+        uint8_t evBits[EV_CNT / 8 + 1];
+        uint8_t keyBits[KEY_CNT / 8 + 1];
+        uint8_t absBits[ABS_CNT / 8 + 1];
+        uint8_t propBits[INPUT_PROP_CNT / 8 + 1];
+        memset(evBits, 0, sizeof(evBits));
+        memset(keyBits, 0, sizeof(keyBits));
+        memset(absBits, 0, sizeof(absBits));
+        memset(propBits, 0, sizeof(propBits));
+        uinput_setup setup;
+        memset(&setup, 0, sizeof(setup));
+        if(
+            ioctl(source, EVIOCGNAME(sizeof(name) - 1), name) == -1
+            || ioctl(source, EVIOCGID, &setup.id) == -1
+            || ioctl(source, EVIOCGBIT(0, sizeof(evBits)), evBits) == -1
+            || ioctl(source, EVIOCGBIT(EV_KEY, sizeof(keyBits)), keyBits) == -1
+            || ioctl(source, EVIOCGBIT(EV_ABS, sizeof(absBits)), absBits) == -1
+            || ioctl(source, EVIOCGPROP(sizeof(propBits)), propBits) == -1
+        ){
+            qDebug() << "Unable to read input device capabilities" << strerror(errno);
+            return false;
+        }
+        fd = ::open("/dev/uinput", O_WRONLY | O_CLOEXEC);
+        if(fd == -1){
+            qDebug() << "Unable to open /dev/uinput" << strerror(errno);
+            return false;
+        }
+        auto hasBit = [](const uint8_t* bits, int bit){ return bits[bit / 8] & (1 << (bit % 8)); };
+        for(int i = 0; i < EV_CNT; i++){
+            if(hasBit(evBits, i)){
+                ioctl(fd, UI_SET_EVBIT, i);
+            }
+        }
+        for(int i = 0; i < KEY_CNT; i++){
+            if(hasBit(keyBits, i)){
+                ioctl(fd, UI_SET_KEYBIT, i);
+            }
+        }
+        for(int i = 0; i < INPUT_PROP_CNT; i++){
+            if(hasBit(propBits, i)){
+                ioctl(fd, UI_SET_PROPBIT, i);
+            }
+        }
+        for(int i = 0; i < ABS_CNT; i++){
+            if(!hasBit(absBits, i)){
+                continue;
+            }
+            uinput_abs_setup abs;
+            memset(&abs, 0, sizeof(abs));
+            abs.code = i;
+            if(ioctl(source, EVIOCGABS(i), &abs.absinfo) == -1){
+                qDebug() << "Unable to read axis" << i << strerror(errno);
+                return false;
+            }
+            ioctl(fd, UI_SET_ABSBIT, i);
+            if(ioctl(fd, UI_ABS_SETUP, &abs) == -1){
+                qDebug() << "Unable to setup axis" << i << strerror(errno);
+                return false;
+            }
+        }
+        snprintf(setup.name, UINPUT_MAX_NAME_SIZE, "oxide: %s", name);
+        if(ioctl(fd, UI_DEV_SETUP, &setup) == -1 || ioctl(fd, UI_DEV_CREATE) == -1){
+            qDebug() << "Unable to create virtual input device" << strerror(errno);
+            return false;
+        }
+        char sysname[64];
+        memset(sysname, 0, sizeof(sysname));
+        if(ioctl(fd, UI_GET_SYSNAME(sizeof(sysname) - 1), sysname) == -1){
+            qDebug() << "Unable to find virtual input device" << strerror(errno);
+            return false;
+        }
+        QDir sys(QString("/sys/devices/virtual/input/") + sysname);
+        auto nodes = sys.entryList(QStringList() << "event*", QDir::Dirs);
+        if(nodes.isEmpty()){
+            qDebug() << "No event device for" << sys.path();
+            return false;
+        }
+        m_path = "/dev/input/" + nodes.first();
+        // udev creates the node in the background
+        for(int i = 0; i < 100 && !QFileInfo::exists(m_path); i++){
+            QThread::msleep(10);
+        }
+        qDebug() << "Created" << m_path << "for" << name;
+        return true;
+    }
+};
+
+#endif // UINPUTDEVICE_H
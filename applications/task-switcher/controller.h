@@ -200,13 +200,15 @@ signals:
     void reload();
 
 private slots:
-    void sigUsr1(){
+    void sigUsr1(int pid){
+        Q_UNUSED(pid)
         ::kill(tarnishPid(), SIGUSR1);
         qDebug() << "Sent to the foreground...";
         saveScreen();
         setState("loading");
     }
-    void sigUsr2(){
+    void sigUsr2(int pid){
+        Q_UNUSED(pid)
         qDebug() << "Sent to the background...";
         setState("hidden");
         QTimer::singleShot(0, [this]{
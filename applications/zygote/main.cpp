@@ -0,0 +1,49 @@
+#include <cstdio>
+#include <cstdlib>
+#include <dlfcn.h>
+
+#include "zygote.h"
+
+// Libraries most applications link against, loaded and relocated before the
+// application is needed
+static const char* preload[] = {
+    "libQt5Core.so.5",
+    "libQt5Gui.so.5",
+    "libQt5DBus.so.5",
+    "libQt5Qml.so.5",
+    "libQt5Quick.so.5",
+    "/usr/lib/plugins/platforms/libepaper.so",
+};
+
+// Kept apart from tarnish so that none of its static initializers, which open
+// input devices, run in the application's process.
+int main(int argc, char* argv[]){
+    if(argc != 2){
+        fprintf(stderr, "Usage: %s <application>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    for(auto library : preload){
+        if(dlopen(library, RTLD_NOW | RTLD_GLOBAL) == nullptr){
+            fprintf(stderr, "Unable to preload %s: %s\n", library, dlerror());
+        }
+    }
+    auto bin = argv[1];
+    // The application's own static initializers run now, not at launch
+    auto handle = dlopen(bin, RTLD_NOW | RTLD_GLOBAL);
+    if(handle == nullptr){
+        fprintf(stderr, "Unable to load %s: %s\n", bin, dlerror());
+        return ZYGOTE_UNSUPPORTED;
+    }
+    auto entry = (int(*)(int, char**))dlsym(handle, ZYGOTE_ENTRY_POINT);
+    if(entry == nullptr){
+        fprintf(stderr, "%s doesn't export " ZYGOTE_ENTRY_POINT "\n", bin);
+        return ZYGOTE_UNSUPPORTED;
+    }
+    char line[32];
+    if(fgets(line, sizeof(line), stdin) == nullptr){
+        // tarnish closed stdin, the application won't be launched
+        return EXIT_SUCCESS;
+    }
+    char* args[] = { bin, nullptr };
+    return entry(1, args);
+}
@@ -0,0 +1,17 @@
+CONFIG += c++17 console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+SOURCES += \
+        main.cpp
+
+TARGET = tarnish-zygote
+
+target.path = /opt/bin
+!isEmpty(target.path): INSTALLS += target
+
+INCLUDEPATH += ../../shared
+HEADERS += \
+    ../../shared/zygote.h
+
+LIBS += -ldl
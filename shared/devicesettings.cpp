@@ -32,6 +32,10 @@ DeviceSettings::DeviceType DeviceSettings::getDeviceType() const {
 }
 
 const char* DeviceSettings::getButtonsDevicePath() const {
+    auto path = getenv("OXIDE_BUTTONS_DEVICE");
+    if(path != nullptr){
+        return path;
+    }
     switch(getDeviceType()) {
         case DeviceType::RM1:
             return "/dev/input/event2";
@@ -43,6 +47,10 @@ const char* DeviceSettings::getButtonsDevicePath() const {
 }
 
 const char* DeviceSettings::getWacomDevicePath() const {
+    auto path = getenv("OXIDE_WACOM_DEVICE");
+    if(path != nullptr){
+        return path;
+    }
     switch(getDeviceType()) {
         case DeviceType::RM1:
             return "/dev/input/event0";
@@ -54,6 +62,10 @@ const char* DeviceSettings::getWacomDevicePath() const {
 }
 
 const char* DeviceSettings::getTouchDevicePath() const {
+    auto path = getenv("OXIDE_TOUCH_DEVICE");
+    if(path != nullptr){
+        return path;
+    }
     switch(getDeviceType()) {
         case DeviceType::RM1:
             return "/dev/input/event1";
@@ -64,15 +76,24 @@ const char* DeviceSettings::getTouchDevicePath() const {
     }
 }
 
-const char* DeviceSettings::getTouchEnvSetting() const {
+QByteArray DeviceSettings::getTouchEnvSetting() const {
+    QByteArray setting;
     switch(getDeviceType()) {
         case DeviceType::RM1:
-            return "rotate=180";
+            setting = "rotate=180";
+        break;
         case DeviceType::RM2:
-            return "rotate=180:invertx";
+            setting = "rotate=180:invertx";
+        break;
         default:
-            return "";
+        break;
+    }
+    // Without a device Qt would find the real one, which tarnish keeps grabbed
+    auto path = getenv("OXIDE_TOUCH_DEVICE");
+    if(path != nullptr){
+        setting = setting.isEmpty() ? QByteArray(path) : path + QByteArray(":") + setting;
     }
+    return setting;
 }
 
 int DeviceSettings::getTouchWidth() const {
@@ -1,6 +1,8 @@
 #ifndef DEVICESETTINGS_H
 #define DEVICESETTINGS_H
 
+#include <QByteArray>
+
 #define deviceSettings DeviceSettings::instance()
 
 #define DEBUG
@@ -12,10 +14,16 @@ public:
         static DeviceSettings INSTANCE;
         return INSTANCE;
     }
+    // Each device path can be overridden from the environment, e.g.
+    // OXIDE_TOUCH_DEVICE=/dev/input/event5 to read a virtual device instead.
+    // tarnish sets the touch and buttons ones to the copies it writes to for
+    // everything it launches. Those real devices stay grabbed, so anything
+    // that opens a hardcoded /dev/input/eventN for them gets no input.
     const char* getButtonsDevicePath() const;
     const char* getWacomDevicePath() const;
     const char* getTouchDevicePath() const;
-    const char* getTouchEnvSetting() const;
+    // Includes OXIDE_TOUCH_DEVICE when it's set
+    QByteArray getTouchEnvSetting() const;
     DeviceType getDeviceType() const;
     int getTouchWidth() const;
     int getTouchHeight() const;
@@ -0,0 +1,138 @@
+#ifndef PENRING_H
+#define PENRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Shared memory ring of decoded wacom frames.
+//
+// tarnish is the only writer, get the memory and a wakeup eventfd from
+// System.penRing(). Any number of readers can follow it without a syscall per
+// frame: poll the eventfd, read it to reset it, then call PenRingReader::read()
+// until it returns 0.
+
+#define PEN_RING_MAGIC 0x4f58504e // OXPN
+#define PEN_RING_VERSION 1
+// Frames kept, a reader further behind than this loses the oldest ones
+#define PEN_RING_SIZE 1024
+
+#define PEN_TOOL_NONE 0
+#define PEN_TOOL_PEN 1
+#define PEN_TOOL_RUBBER 2
+
+#define PEN_FLAG_TOUCHING 0x1
+#define PEN_FLAG_BUTTON 0x2
+#define PEN_FLAG_BUTTON2 0x4
+
+// Range of a raw axis as the kernel reports it, values aren't rotated to
+// match the screen
+struct PenAxis {
+    int32_t minimum;
+    int32_t maximum;
+    int32_t resolution;
+};
+
+// The pen's state after a SYN_REPORT
+struct PenFrame {
+    // From the input event, in CLOCK_MONOTONIC microseconds
+    int64_t timestamp;
+    int32_t x;
+    int32_t y;
+    int32_t pressure;
+    int32_t distance;
+    int32_t tiltX;
+    int32_t tiltY;
+    uint16_t tool;
+    uint16_t flags;
+};
+
+struct PenRingSlot {
+    // Frame number plus one once the frame is complete, 0 while it's written
+    std::atomic<uint32_t> sequence;
+    PenFrame frame;
+};
+
+struct PenRingLayout {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t slotSize;
+    PenAxis x;
+    PenAxis y;
+    PenAxis pressure;
+    PenAxis distance;
+    PenAxis tiltX;
+    PenAxis tiltY;
+    // Frames written so far, the newest is in entries[(head - 1) % size]
+    std::atomic<uint32_t> head;
+    PenRingSlot entries[PEN_RING_SIZE];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "The ring needs lock free atomics to be shared between processes");
+
+class PenRingReader {
+public:
+    PenRingReader() : ring(nullptr), cursor(0) {}
+    ~PenRingReader(){ unmap(); }
+    // Maps the memory read only, starting after the newest frame. fd can be
+    // closed afterwards.
+    bool map(int fd){
+        unmap();
+        auto memory = mmap(nullptr, sizeof(PenRingLayout), PROT_READ, MAP_SHARED, fd, 0);
+        if(memory == MAP_FAILED){
+            return false;
+        }
+        ring = (const PenRingLayout*)memory;
+        if(
+            ring->magic != PEN_RING_MAGIC
+            || ring->version != PEN_RING_VERSION
+            || ring->size != PEN_RING_SIZE
+            || ring->slotSize != sizeof(PenRingSlot)
+        ){
+            unmap();
+            return false;
+        }
+        cursor = ring->head.load(std::memory_order_acquire);
+        return true;
+    }
+    void unmap(){
+        if(ring != nullptr){
+            munmap((void*)ring, sizeof(PenRingLayout));
+            ring = nullptr;
+        }
+    }
+    const PenRingLayout* info(){ return ring; }
+    // Copies frames written since the last call, oldest first
+    size_t read(PenFrame* frames, size_t max){
+        if(ring == nullptr){
+            return 0;
+        }
+        auto head = ring->head.load(std::memory_order_acquire);
+        if(head - cursor > PEN_RING_SIZE){
+            // Lapped, skip to the oldest frame still there
+            cursor = head - PEN_RING_SIZE;
+        }
+        size_t count = 0;
+        while(count < max && cursor != head){
+            auto& slot = ring->entries[cursor % PEN_RING_SIZE];
+            auto sequence = slot.sequence.load(std::memory_order_acquire);
+            frames[count] = slot.frame;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // Overwritten while copying, or already replaced by a newer frame
+            if(sequence == cursor + 1 && slot.sequence.load(std::memory_order_relaxed) == sequence){
+                count++;
+            }
+            cursor++;
+        }
+        return count;
+    }
+
+private:
+    const PenRingLayout* ring;
+    uint32_t cursor;
+};
+
+#endif // PENRING_H
@@ -0,0 +1,219 @@
+#ifndef SCREENCODEC_H
+#define SCREENCODEC_H
+
+#include <QByteArray>
+#include <QThread>
+#include <QList>
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#define SCREENCODEC_MAGIC 0x4c52584f // OXRL
+#define SCREENCODEC_MAX_STRIPES 8
+#define SCREENCODEC_MIN_RUN 3
+#define SCREENCODEC_MAX_TOKEN 0x8000
+#define SCREENCODEC_RUN_FLAG 0x8000
+
+// Run-length codec for RGB565 screen captures.
+//
+// E-ink frames are mostly long runs of white or black, so a 16-bit run-length
+// encoding gets close to zlib's ratio at a fraction of the cost. The frame is
+// split into stripes that are encoded and decoded on their own thread so both
+// rM2 cores are used.
+//
+// Layout: header, one quint32 encoded size per stripe, then the stripes.
+// A stripe is a sequence of 16-bit tokens. A token with the high bit set is a
+// run of (token & 0x7fff) + 1 copies of the following pixel, otherwise it is
+// followed by token + 1 literal pixels.
+struct ScreenCodecHeader {
+    quint32 magic;
+    quint32 pixels;
+    quint32 stripes;
+};
+
+class ScreenCodec {
+public:
+    static QByteArray encode(const uint16_t* pixels, size_t count, int stripes = 0){
+        stripes = stripeCount(count, stripes);
+        QList<QByteArray> encoded;
+        for(int i = 0; i < stripes; i++){
+            encoded.append(QByteArray());
+        }
+        QList<QThread*> threads;
+        for(int i = 1; i < stripes; i++){
+            auto thread = QThread::create([&encoded, pixels, count, stripes, i]{
+                encoded[i] = encodeStripe(pixels, count, stripes, i);
+            });
+            thread->start();
+            threads.append(thread);
+        }
+        encoded[0] = encodeStripe(pixels, count, stripes, 0);
+        for(auto thread : threads){
+            thread->wait();
+            delete thread;
+        }
+        ScreenCodecHeader header{
+            .magic = SCREENCODEC_MAGIC,
+            .pixels = (quint32)count,
+            .stripes = (quint32)stripes,
+        };
+        QByteArray result;
+        int size = sizeof(header) + sizeof(quint32) * stripes;
+        for(auto stripe : encoded){
+            size += stripe.size();
+        }
+        result.reserve(size);
+        result.append((const char*)&header, sizeof(header));
+        for(auto stripe : encoded){
+            quint32 stripeSize = stripe.size();
+            result.append((const char*)&stripeSize, sizeof(stripeSize));
+        }
+        for(auto stripe : encoded){
+            result.append(stripe);
+        }
+        return result;
+    }
+    static bool decode(const QByteArray& data, uint16_t* pixels, size_t count){
+        if((size_t)data.size() < sizeof(ScreenCodecHeader)){
+            return false;
+        }
+        ScreenCodecHeader header;
+        memcpy(&header, data.constData(), sizeof(header));
+        if(
+            header.magic != SCREENCODEC_MAGIC
+            || header.pixels != count
+            || !header.stripes
+            || header.stripes > SCREENCODEC_MAX_STRIPES
+            || header.stripes != (quint32)stripeCount(count, header.stripes)
+        ){
+            return false;
+        }
+        int stripes = header.stripes;
+        size_t offset = sizeof(header) + sizeof(quint32) * stripes;
+        if((size_t)data.size() < offset){
+            return false;
+        }
+        QList<const uint16_t*> starts;
+        QList<size_t> sizes;
+        for(int i = 0; i < stripes; i++){
+            quint32 stripeSize;
+            memcpy(&stripeSize, data.constData() + sizeof(header) + sizeof(quint32) * i, sizeof(stripeSize));
+            if(stripeSize % sizeof(uint16_t) || offset + stripeSize > (size_t)data.size()){
+                return false;
+            }
+            starts.append((const uint16_t*)(data.constData() + offset));
+            sizes.append(stripeSize / sizeof(uint16_t));
+            offset += stripeSize;
+        }
+        QList<bool> results;
+        for(int i = 0; i < stripes; i++){
+            results.append(false);
+        }
+        QList<QThread*> threads;
+        for(int i = 1; i < stripes; i++){
+            auto thread = QThread::create([&results, &starts, &sizes, pixels, count, stripes, i]{
+                results[i] = decodeStripe(starts[i], sizes[i], pixels, count, stripes, i);
+            });
+            thread->start();
+            threads.append(thread);
+        }
+        results[0] = decodeStripe(starts[0], sizes[0], pixels, count, stripes, 0);
+        for(auto thread : threads){
+            thread->wait();
+            delete thread;
+        }
+        return !results.contains(false);
+    }
+
+private:
+    static int stripeCount(size_t count, int stripes){
+        if(stripes <= 0){
+            stripes = QThread::idealThreadCount();
+        }
+        if(stripes > SCREENCODEC_MAX_STRIPES){
+            stripes = SCREENCODEC_MAX_STRIPES;
+        }
+        if((size_t)stripes > count){
+            stripes = count;
+        }
+        return stripes < 1 ? 1 : stripes;
+    }
+    static size_t stripeStart(size_t count, int stripes, int stripe){ return count / stripes * stripe; }
+    static size_t stripeEnd(size_t count, int stripes, int stripe){
+        return stripe == stripes - 1 ? count : stripeStart(count, stripes, stripe + 1);
+    }
+    static QByteArray encodeStripe(const uint16_t* pixels, size_t count, int stripes, int stripe){
+        auto start = pixels + stripeStart(count, stripes, stripe);
+        size_t size = stripeEnd(count, stripes, stripe) - stripeStart(count, stripes, stripe);
+        // Every literal token is either the first token or follows a run that
+        // saved at least one word, so this is the worst case.
+        QByteArray result;
+        result.resize((size + size / SCREENCODEC_MAX_TOKEN + 2) * sizeof(uint16_t));
+        auto out = (uint16_t*)result.data();
+        size_t written = 0;
+        size_t literal = 0;
+        size_t i = 0;
+        while(i < size){
+            auto value = start[i];
+            size_t run = 1;
+            while(i + run < size && run < SCREENCODEC_MAX_TOKEN && start[i + run] == value){
+                run++;
+            }
+            if(run < SCREENCODEC_MIN_RUN){
+                i += run;
+                continue;
+            }
+            written += writeLiteral(out + written, start + literal, i - literal);
+            out[written++] = SCREENCODEC_RUN_FLAG | (run - 1);
+            out[written++] = value;
+            i += run;
+            literal = i;
+        }
+        written += writeLiteral(out + written, start + literal, size - literal);
+        result.resize(written * sizeof(uint16_t));
+        return result;
+    }
+    static size_t writeLiteral(uint16_t* out, const uint16_t* pixels, size_t size){
+        size_t written = 0;
+        while(size){
+            size_t length = size < SCREENCODEC_MAX_TOKEN ? size : SCREENCODEC_MAX_TOKEN;
+            out[written++] = length - 1;
+            memcpy(out + written, pixels, length * sizeof(uint16_t));
+            written += length;
+            pixels += length;
+            size -= length;
+        }
+        return written;
+    }
+    static bool decodeStripe(const uint16_t* data, size_t size, uint16_t* pixels, size_t count, int stripes, int stripe){
+        auto out = pixels + stripeStart(count, stripes, stripe);
+        size_t remaining = stripeEnd(count, stripes, stripe) - stripeStart(count, stripes, stripe);
+        size_t i = 0;
+        while(i < size){
+            auto token = data[i++];
+            size_t length = (token & ~SCREENCODEC_RUN_FLAG) + 1;
+            if(length > remaining){
+                return false;
+            }
+            if(token & SCREENCODEC_RUN_FLAG){
+                if(i >= size){
+                    return false;
+                }
+                auto value = data[i++];
+                std::fill(out, out + length, value);
+            }else{
+                if(i + length > size){
+                    return false;
+                }
+                memcpy(out, data + i, length * sizeof(uint16_t));
+                i += length;
+            }
+            out += length;
+            remaining -= length;
+        }
+        return !remaining;
+    }
+};
+
+#endif // SCREENCODEC_H
@@ -9,11 +9,14 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include <errno.h>
 
 #define signalHandler SignalHandler::singleton()
 
 static int sigUsr1Fd[2];
 static int sigUsr2Fd[2];
+static int sigChldFd[2];
+static struct sigaction previousSigChld;
 
 class SignalHandler : public QObject
 {
@@ -32,17 +35,17 @@ public:
         }
         struct sigaction usr1, usr2;
 
-        usr1.sa_handler = SignalHandler::usr1SignalHandler;
+        usr1.sa_sigaction = SignalHandler::usr1SignalHandler;
         sigemptyset(&usr1.sa_mask);
-        usr1.sa_flags = 0;
+        usr1.sa_flags = SA_SIGINFO;
         usr1.sa_flags |= SA_RESTART;
         if(sigaction(SIGUSR1, &usr1, 0)){
             return 1;
         }
 
-        usr2.sa_handler = SignalHandler::usr2SignalHandler;
+        usr2.sa_sigaction = SignalHandler::usr2SignalHandler;
         sigemptyset(&usr2.sa_mask);
-        usr2.sa_flags = 0;
+        usr2.sa_flags = SA_SIGINFO;
         usr2.sa_flags |= SA_RESTART;
         if(sigaction(SIGUSR2, &usr2, 0)){
             return 2;
@@ -50,6 +53,25 @@ public:
 
         return 0;
     }
+    // QProcess installs its own SIGCHLD handler with SA_NOCLDSTOP the first
+    // time it starts a process. Call this after that has happened so that stop
+    // and continue notifications are delivered too. The QProcess handler is
+    // still called for every signal.
+    static int setup_sigchld_handler(){
+        struct sigaction current;
+        if(sigaction(SIGCHLD, nullptr, &current)){
+            return 1;
+        }
+        if((current.sa_flags & SA_SIGINFO) && current.sa_sigaction == SignalHandler::chldSignalHandler){
+            return 0;
+        }
+        previousSigChld = current;
+        struct sigaction chld;
+        chld.sa_sigaction = SignalHandler::chldSignalHandler;
+        sigemptyset(&chld.sa_mask);
+        chld.sa_flags = SA_RESTART | SA_SIGINFO;
+        return sigaction(SIGCHLD, &chld, 0);
+    }
     SignalHandler(QObject *parent = 0) : QObject(parent){
         singleton(this);
         if(::socketpair(AF_UNIX, SOCK_STREAM, 0, sigUsr1Fd)){
@@ -58,47 +80,83 @@ public:
         if(::socketpair(AF_UNIX, SOCK_STREAM, 0, sigUsr2Fd)){
            qFatal("Couldn't create USR2 socketpair");
         }
+        if(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sigChldFd)){
+           qFatal("Couldn't create CHLD socketpair");
+        }
 
         snUsr1 = new QSocketNotifier(sigUsr1Fd[1], QSocketNotifier::Read, this);
         connect(snUsr1, &QSocketNotifier::activated, this, &SignalHandler::handleSigUsr1);
         snUsr2 = new QSocketNotifier(sigUsr2Fd[1], QSocketNotifier::Read, this);
         connect(snUsr2, &QSocketNotifier::activated, this, &SignalHandler::handleSigUsr2);
+        snChld = new QSocketNotifier(sigChldFd[1], QSocketNotifier::Read, this);
+        connect(snChld, &QSocketNotifier::activated, this, &SignalHandler::handleSigChld);
     }
     ~SignalHandler(){}
 
-    static void usr1SignalHandler(int unused){
-        Q_UNUSED(unused)
-        char a = 1;
-        ::write(sigUsr1Fd[0], &a, sizeof(a));
+    // The sender is passed along so acknowledgements can be matched to the
+    // application that sent them
+    static void usr1SignalHandler(int signal, siginfo_t* info, void* context){
+        Q_UNUSED(signal)
+        Q_UNUSED(context)
+        auto error = errno;
+        pid_t pid = info->si_pid;
+        ::write(sigUsr1Fd[0], &pid, sizeof(pid));
+        errno = error;
     }
-    static void usr2SignalHandler(int unused){
-        Q_UNUSED(unused)
+    static void usr2SignalHandler(int signal, siginfo_t* info, void* context){
+        Q_UNUSED(signal)
+        Q_UNUSED(context)
+        auto error = errno;
+        pid_t pid = info->si_pid;
+        ::write(sigUsr2Fd[0], &pid, sizeof(pid));
+        errno = error;
+    }
+    static void chldSignalHandler(int signal, siginfo_t* info, void* context){
+        auto error = errno;
         char a = 1;
-        ::write(sigUsr2Fd[0], &a, sizeof(a));
+        ::write(sigChldFd[0], &a, sizeof(a));
+        if(previousSigChld.sa_flags & SA_SIGINFO){
+            previousSigChld.sa_sigaction(signal, info, context);
+        }else if(previousSigChld.sa_handler != SIG_DFL && previousSigChld.sa_handler != SIG_IGN){
+            previousSigChld.sa_handler(signal);
+        }
+        errno = error;
     }
 
 public slots:
     void handleSigUsr1(){
         snUsr1->setEnabled(false);
-        char tmp;
-        ::read(sigUsr1Fd[1], &tmp, sizeof(tmp));
-        emit sigUsr1();
+        pid_t pid;
+        if(::read(sigUsr1Fd[1], &pid, sizeof(pid)) == sizeof(pid)){
+            emit sigUsr1(pid);
+        }
         snUsr1->setEnabled(true);
     }
     void handleSigUsr2(){
         snUsr2->setEnabled(false);
-        char tmp;
-        ::read(sigUsr2Fd[1], &tmp, sizeof(tmp));
-        emit sigUsr2();
+        pid_t pid;
+        if(::read(sigUsr2Fd[1], &pid, sizeof(pid)) == sizeof(pid)){
+            emit sigUsr2(pid);
+        }
         snUsr2->setEnabled(true);
     }
+    void handleSigChld(){
+        snChld->setEnabled(false);
+        // Signals coalesce, drain everything and handle them once
+        char tmp[32];
+        while(::read(sigChldFd[1], &tmp, sizeof(tmp)) > 0);
+        emit sigChld();
+        snChld->setEnabled(true);
+    }
 
 signals:
-    void sigUsr1();
-    void sigUsr2();
+    void sigUsr1(int pid);
+    void sigUsr2(int pid);
+    void sigChld();
 
 private:
     QSocketNotifier* snUsr1;
     QSocketNotifier* snUsr2;
+    QSocketNotifier* snChld;
 };
 #endif // SIGNALHANDLER_H
@@ -0,0 +1,131 @@
+#ifndef TOUCHTRACKER_H
+#define TOUCHTRACKER_H
+
+#include <QtGlobal>
+#include <QVector>
+
+#include <string>
+#include <linux/input.h>
+
+// Touch slots are tracked with bitmasks, any past this are ignored
+#define TOUCH_MAX_SLOTS 32
+
+struct Touch {
+    int slot = 0;
+    int id = -1;
+    int x = 0;
+    int y = 0;
+    bool active = false;
+    bool existing = false;
+    bool modified = true;
+    int pressure = 0;
+    int major = 0;
+    int minor = 0;
+    int orientation = 0;
+    std::string debugString() const{
+        return "<Touch " + std::to_string(id) + " (" + std::to_string(x) + ", " + std::to_string(y) + ") " + (active ? "pressed" : "released") + ">";
+    }
+};
+
+// Follows the contacts of a multitouch slot protocol device.
+//
+// Contacts are kept in a vector indexed by slot, with bitmasks for the slots
+// holding one, so a frame doesn't allocate. Shared with patina so it can be
+// benchmarked without tarnish.
+class TouchTracker {
+public:
+    TouchTracker(int slotCount)
+    : touches(qBound(1, slotCount, TOUCH_MAX_SLOTS)),
+      usedSlots(0),
+      activeSlots(0),
+      currentSlot(0) {}
+    // Returns true when event completes a frame, active() is then the slots
+    // with a contact down
+    bool handle(const input_event& event){
+        if(event.type == EV_ABS){
+            if(event.code == ABS_MT_SLOT){
+                currentSlot = event.value;
+                return false;
+            }
+            auto touch = getEvent(currentSlot);
+            if(touch == nullptr){
+                return false;
+            }
+            touch->modified = true;
+            switch(event.code){
+                case ABS_MT_TRACKING_ID:
+                    touch->active = event.value != -1;
+                    touch->id = event.value;
+                break;
+                case ABS_MT_POSITION_X:
+                    touch->x = event.value;
+                break;
+                case ABS_MT_POSITION_Y:
+                    touch->y = event.value;
+                break;
+                case ABS_MT_PRESSURE:
+                    touch->pressure = event.value;
+                break;
+                case ABS_MT_TOUCH_MAJOR:
+                    touch->major = event.value;
+                break;
+                case ABS_MT_TOUCH_MINOR:
+                    touch->minor = event.value;
+                break;
+                case ABS_MT_ORIENTATION:
+                    touch->orientation = event.value;
+                break;
+            }
+            return false;
+        }
+        if(event.type != EV_SYN || event.code != SYN_REPORT){
+            return false;
+        }
+        quint32 active = 0;
+        forEach(usedSlots, [&active](Touch* touch){
+            if(touch->active){
+                active |= 1u << touch->slot;
+            }
+        });
+        // Forget released touches and setup the rest for the next frame
+        usedSlots = active;
+        forEach(usedSlots, [](Touch* touch){
+            touch->modified = false;
+            touch->existing = true;
+        });
+        activeSlots = active;
+        return true;
+    }
+    quint32 active() const{ return activeSlots; }
+    Touch* touch(int slot){ return &touches[slot]; }
+    template<typename F>
+    void forEach(quint32 mask, F callback){
+        for(; mask; mask &= mask - 1){
+            callback(&touches[__builtin_ctz(mask)]);
+        }
+    }
+
+private:
+    // One entry per slot reported by the device, only those in usedSlots
+    // hold a contact
+    QVector<Touch> touches;
+    quint32 usedSlots;
+    quint32 activeSlots;
+    int currentSlot;
+
+    Touch* getEvent(int slot){
+        if(slot < 0 || slot >= touches.size()){
+            return nullptr;
+        }
+        auto bit = 1u << slot;
+        if(!(usedSlots & bit)){
+            touches[slot] = Touch{
+                .slot = slot
+            };
+            usedSlots |= bit;
+        }
+        return &touches[slot];
+    }
+};
+
+#endif // TOUCHTRACKER_H
@@ -0,0 +1,23 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+// Protocol between tarnish and tarnish-zygote.
+//
+// Applications with the zygote flag are started ahead of time as
+// `tarnish-zygote <bin>`, with the sandbox already applied by SandBoxProcess.
+// The zygote loads the Qt libraries and the application, then waits for
+// ZYGOTE_LAUNCH on stdin before calling its entry point. Closing stdin instead
+// makes it exit.
+//
+// Only applications built as a shared object exporting ZYGOTE_ENTRY_POINT can
+// be run in place, glibc refuses to dlopen a regular PIE executable. The zygote
+// exits with ZYGOTE_UNSUPPORTED for anything else, and tarnish launches those
+// normally from then on. /proc/self/exe is still the zygote, so an application
+// run this way shouldn't rely on QCoreApplication::applicationFilePath().
+
+#define ZYGOTE_BIN "tarnish-zygote"
+#define ZYGOTE_LAUNCH "launch\n"
+#define ZYGOTE_ENTRY_POINT "main"
+#define ZYGOTE_UNSUPPORTED 126
+
+#endif // ZYGOTE_H